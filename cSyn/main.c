@@ -1,15 +1,48 @@
 // Author: Aas1kkk
 // Date: 2024-07-13
 // Description: A tool designed to analyze and validate the syntax of C and C++ codebases. It ensures code quality by detecting common syntax errors and providing detailed reports.
-// File version: 1.2
-// Last Update: 2024-07-17
+// File version: 1.3
+// Last Update: 2026-10-19
 // License: GNU License
-// Recent changes: Added support for multiple file inputs, C++ specific constructs, improved output format, and added cyclomatic complexity calculation.
+// Recent changes: Added clone detection (--clones), io_uring file loading (--io), watch mode (--watch), a findings store with query/diff subcommands and a declaration pass for variable counting.
+
+#define _GNU_SOURCE
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <time.h>
+#include <stdarg.h>
+
+// io_uring is used for batched file loading where the kernel headers provide it
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define HAVE_IO_URING 1
+#include <linux/io_uring.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <errno.h>
+#endif
+#endif
+
+// Watch mode relies on inotify to learn which files changed
+#if defined(__linux__) && defined(__has_include)
+#if __has_include(<sys/inotify.h>)
+#define HAVE_INOTIFY 1
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <poll.h>
+#include <dirent.h>
+#include <errno.h>
+#endif
+#endif
 
 // Structure to store each line of the file along with its line number and length
 typedef struct {
@@ -18,6 +51,333 @@ typedef struct {
     char line_text[1024];
 } FileLine;
 
+// Clone detection tuning: a copied block is guaranteed to be found once it spans
+// at least CLONE_KGRAM + CLONE_WINDOW - 1 normalized tokens
+#define CLONE_KGRAM 20
+#define CLONE_WINDOW 12
+#define CLONE_SHARDS 64
+#define CLONE_MIN_LINES 4
+#define CLONE_MERGE_GAP 8
+#define CLONE_DEFAULT_BUDGET 4000000
+#define DEFAULT_THREADS 4
+#define DEFAULT_READ_AHEAD 64
+
+// Checks that produce findings; the names are what the findings store and its queries show
+#define CHECK_BRACKETS 0
+#define CHECK_KEYWORD 1
+#define CHECK_LOOP 2
+#define CHECK_BUILTIN 3
+#define CHECK_PRINT_SCAN 4
+#define CHECK_FILE_OPERATION 5
+#define CHECK_SEMICOLON 6
+#define CHECK_CLASS 7
+#define CHECK_TEMPLATE 8
+#define CHECK_CLONE 9
+#define CHECK_UNUSED 10
+#define CHECK_SHADOW 11
+#define CHECK_COUNT 12
+
+static const char *check_names[CHECK_COUNT] = {
+    "brackets", "keyword", "loop", "builtin", "print-scan", "file-operation", "semicolon", "class", "template", "clone",
+    "unused", "shadow"
+};
+
+// Kinds of tokens produced by the source scanner
+#define TOKEN_IDENTIFIER 0
+#define TOKEN_NUMBER 1
+#define TOKEN_LITERAL 2
+#define TOKEN_PUNCTUATION 3
+
+// Kinds of scopes and declarations tracked by the declaration pass
+#define SCOPE_FILE 0    // File or namespace scope
+#define SCOPE_BLOCK 1   // Braced block, including function bodies
+#define SCOPE_FOR 2     // Variables declared in a for loop header
+#define SCOPE_MEMBERS 3 // Body of a struct, union or class
+
+#define DECLARATION_VARIABLE 0
+#define DECLARATION_PARAMETER 1
+#define DECLARATION_TYPE 2
+#define DECLARATION_LOOKBEHIND 2 // Tokens before the parse position that are still looked at
+
+#define FINDINGS_MAGIC "CSYNFIND"
+#define FINDINGS_VERSION 2 // Version 2 added the line hash column; version 1 stores are still read
+#define DIFF_MATCHED 0x80000000u // Marks a finding paired with one from the other run during a diff
+#define DIFF_ALIGN_LIMIT (1u << 22) // Largest alignment table built for one group; bigger groups pair in order
+
+// Watch mode: re-analysis starts once no event arrived for the debounce delay,
+// but never later than WATCH_MAX_DELAY_MS after the first pending event
+#define WATCH_DEBOUNCE_MS 25
+#define WATCH_MAX_DELAY_MS 500
+
+// Backends used to load input files ahead of the analysis
+#define IO_BACKEND_AUTO 0
+#define IO_BACKEND_STDIO 1
+#define IO_BACKEND_THREADS 2
+#define IO_BACKEND_URING 3
+
+// Contents of one input file, loaded ahead of its analysis
+typedef struct {
+    char *data;
+    size_t size;
+    int status; // 0 = loaded, -1 = could not be opened or read, -2 = memory allocation failed
+    int ready;
+} LoadedFile;
+
+#ifdef HAVE_IO_URING
+// A minimal io_uring instance driven through the raw system calls
+typedef struct {
+    int fd;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ring, *cq_ring;
+    size_t sq_ring_size, cq_ring_size, sqes_size;
+    unsigned sq_entries;
+    unsigned to_submit;
+} IoRing;
+
+// Per-file state of an io_uring load, indexed by file index modulo the read-ahead window
+typedef struct {
+    struct statx stat;
+    int fd;
+    int pending;      // Open and statx completions still expected
+    int open_result;
+    int stat_result;
+    size_t offset;
+} IoRingSlot;
+#endif
+
+#ifdef HAVE_INOTIFY
+// A source file under watch, with its latest analysis kept in memory
+typedef struct {
+    char *path;
+    char *report;
+    size_t report_size;
+    int dirty;
+    int deleted;
+} WatchedFile;
+
+// A watched directory, identified by its inotify watch descriptor
+typedef struct {
+    int wd;
+    char *path;
+} WatchedDirectory;
+
+// Everything watch mode keeps between re-analyses; files are sorted by path
+typedef struct {
+    int inotify_fd;
+    WatchedFile *files;
+    int file_count;
+    int file_capacity;
+    WatchedDirectory *directories;
+    int directory_count;
+    int directory_capacity;
+} WatchState;
+#endif
+
+// Shared state for the background file loaders
+// At most read_ahead files past the last one released by the analysis are loaded or in flight
+typedef struct {
+    char **filenames;
+    int file_count;
+    int read_ahead;
+    int backend;
+    LoadedFile *files;
+    int next_to_start;
+    int released;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    pthread_t *threads;
+    int thread_count;
+#ifdef HAVE_IO_URING
+    IoRing ring;
+#endif
+} FileLoader;
+
+// Interned strings: each distinct string is stored once in a growing arena and identified by a dense id
+// Ids are found through an open-addressing hash table, so lookups stay O(1) however many strings there are
+typedef struct {
+    char *arena;
+    size_t arena_size;
+    size_t arena_capacity;
+    size_t *offsets;   // Arena offset of each string, by id
+    uint32_t *lengths;
+    uint32_t *hashes;
+    int count;
+    int capacity;
+    int *slots;        // Hash table of ids, -1 when empty
+    size_t slot_count; // Always a power of two
+} StringTable;
+
+// Findings kept as columns: one entry per finding in each array, strings dictionary-encoded
+typedef struct {
+    StringTable files;
+    StringTable messages;
+    StringTable checks;
+    uint32_t *file_ids;
+    uint32_t *line_numbers;
+    uint8_t *check_ids;
+    uint32_t *message_ids;
+    uint16_t *line_hashes; // Hash of the line text with whitespace removed, 0 when unknown
+    size_t count;
+    size_t capacity;
+} FindingStore;
+
+// A normalized token with the source line it came from
+typedef struct {
+    uint64_t hash;
+    int line_number;
+} CloneToken;
+
+// A winnowed fingerprint: hash of a k-gram of tokens and where it was found
+typedef struct {
+    uint64_t hash;
+    int file_id;
+    int line_start;
+    int line_end;
+} CloneFingerprint;
+
+// One shard of the global fingerprint index, selected by the top bits of the hash
+typedef struct {
+    pthread_mutex_t lock;
+    CloneFingerprint *entries;
+    size_t count;
+    size_t capacity;
+    uint64_t sample_mask; // Only hashes with (hash & sample_mask) == 0 are kept
+} CloneShard;
+
+// A pair of matching line ranges, before and after merging; file_a is the first location of the fingerprint
+typedef struct {
+    int file_a;
+    int a_start;
+    int a_end;
+    int file_b;
+    int b_start;
+    int b_end;
+} ClonePair;
+
+// One copy of a cloned block
+typedef struct {
+    int file_id;
+    int line_start;
+    int line_end;
+} CloneLocation;
+
+// Shared state for the clone detection workers
+// The analysis hands over the lines of each file it has parsed, in file order, and the workers fingerprint them
+typedef struct {
+    char **filenames;
+    int file_count;
+    atomic_int next_file;
+    CloneShard shards[CLONE_SHARDS];
+    size_t shard_budget;
+    int max_copies; // Clone classes with more copies are counted as boilerplate, 0 for no limit
+    FileLine **lines;
+    int *line_counts;
+    int submitted;  // Files handed over so far
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+    pthread_t *threads;
+    int thread_count;
+} CloneIndex;
+
+// A token of a source line; the text points into the line it came from
+typedef struct {
+    int kind;
+    int length;
+    int line_number;
+    const char *text;
+} SourceToken;
+
+// A name declared in a live scope
+typedef struct {
+    int name_id;
+    int line_number;
+    int previous;  // Declaration of the same name this one hides, -1 if none
+    int scope;     // Index of the scope it belongs to
+    uint8_t kind;
+    uint8_t used;
+} Declaration;
+
+// A scope on the scope stack; its declarations are the top of the declaration stack from first_declaration on
+typedef struct {
+    int kind;
+    int first_declaration;
+    int function;    // Function whose body this scope belongs to, -1 outside functions
+    int paren_depth; // For loops: parenthesis depth at the loop header
+    int state;       // For loops: 0 = in header, 1 = braced body, 2 = single statement body
+                     // Members: 1 if declarators follow the closing brace, 2 if they declare type names
+} Scope;
+
+// Declarations counted for one function definition
+typedef struct {
+    int name_id;
+    int line_number;
+    int parameters;
+    int locals;
+} FunctionDeclarations;
+
+// An unused or shadowing declaration, reported once the pass is done
+typedef struct {
+    int line_number;
+    int check_id;
+    int name_id;
+    int detail;     // Unused: kind of declaration; shadow: line of the shadowed declaration
+    int order;
+} DeclarationFinding;
+
+// State of the declaration pass over one file
+// Names are interned, and each name id maps to its innermost live declaration, so lookups are O(1).
+// Declarations live on a stack that is cut back when their scope closes, so memory is bounded by
+// the declarations in scope rather than by the size of the file.
+typedef struct {
+    StringTable names;
+    int type_keywords;      // Names with ids below this are type keywords,
+    int qualifier_keywords; // then qualifiers and storage classes,
+    int tag_keywords;       // then struct, union, enum and class,
+    int control_keywords;   // then if, while and switch,
+    int prefix_keywords;    // then else and do,
+    int label_keywords;     // then case, default and access specifiers,
+    int keyword_count;      // then all other keywords
+    int typedef_id, enum_id, for_id, else_id, namespace_id, extern_id, template_id;
+    int *bindings;          // Innermost live declaration of each name id, -1 if none
+    int binding_capacity;
+    Declaration *declarations;
+    int declaration_count;
+    int declaration_capacity;
+    Scope *scopes;
+    int scope_count;
+    int scope_capacity;
+    FunctionDeclarations *functions;
+    int function_count;
+    int function_capacity;
+    DeclarationFinding *findings;
+    int finding_count;
+    int finding_capacity;
+    FileLine *lines;         // Lines whose tokens are scanned on demand
+    int total_lines;
+    int next_line;
+    int in_block_comment;
+    int in_directive;        // Set while a preprocessor directive continues on the next line
+    SourceToken *tokens;     // Window of scanned tokens; tokens[0] is token number token_base of the file
+    int token_base;
+    int token_count;
+    int token_capacity;
+    int *pending_parameters; // Parameters of the last function declarator, as name id and line pairs
+    int pending_count;
+    int pending_capacity;
+    int *pending_uses;       // Names read by the last constructor initializer list, marked once its parameters are declared
+    int pending_use_count;
+    int pending_use_capacity;
+    int pending_function;    // Name id of a function whose body comes next, -1 if none
+    int pending_line;
+    int variable_count;
+    int parameter_count;
+    int is_cpp;
+    int failed;              // Set when memory allocation failed
+} DeclarationPass;
+
 // Function declarations
 void print_lines(FileLine lines[], int total_lines, FILE *output_file);
 int find_comment_position(char line[], int line_length);
@@ -29,7 +389,7 @@ void check_builtin_functions(FileLine lines[], int total_lines, FILE *output_fil
 void check_print_scan_functions(FileLine lines[], int total_lines, FILE *output_file);
 int is_print_function(char line[], int line_length);
 int is_scan_function(char line[], int line_length);
-void count_variables(FileLine lines[], int total_lines, FILE *output_file);
+void count_variables(FileLine lines[], int total_lines, FILE *output_file, int is_cpp);
 void check_file_operations(FileLine lines[], int total_lines, FILE *output_file);
 int is_for_loop(char *line, int length);
 int is_while_loop(char *line, int length);
@@ -40,50 +400,165 @@ void check_cpp_specific_constructs(FileLine lines[], int total_lines, FILE *outp
 void check_class_usage(FileLine lines[], int total_lines, FILE *output_file);
 void check_templates(FileLine lines[], int total_lines, FILE *output_file);
 void analyze_file(const char *input_filename, FILE *output_file);
+void print_usage(const char *program_name);
+void report_finding(FILE *output_file, int line_number, int check_id, const char *format, ...);
+void record_finding(int line_number, int check_id, const char *message);
+void set_active_finding_file(const char *filename, const FileLine lines[], int total_lines);
+int string_table_init(StringTable *table);
+int string_table_intern(StringTable *table, const char *text, size_t length);
+int string_table_find(const StringTable *table, const char *text, size_t length);
+const char *string_table_get(const StringTable *table, int id);
+void string_table_free(StringTable *table);
+int finding_store_init(FindingStore *store);
+int finding_store_add(FindingStore *store, int file_id, int line_number, int check_id, int message_id, uint16_t line_hash);
+int finding_store_write(const FindingStore *store, const char *filename);
+int finding_store_read(FindingStore *store, const char *filename);
+void finding_store_free(FindingStore *store);
+int run_findings_query(int argc, char *argv[]);
+int run_findings_diff(int argc, char *argv[]);
+int detect_file_type(const char *filename);
+int read_file_contents(const char *filename, char **data_out, size_t *size_out);
+int parse_file_lines(const char *data, size_t size, FileLine **lines_out, int *total_out);
+void analyze_loaded_file(const char *input_filename, const LoadedFile *loaded, FILE *output_file, FileLine **lines_out, int *total_out);
+int file_loader_start(FileLoader *loader, char *filenames[], int file_count, int backend, int read_ahead, int thread_count);
+LoadedFile *file_loader_wait(FileLoader *loader, int index);
+void file_loader_release(FileLoader *loader, int index);
+void file_loader_finish(FileLoader *loader);
+void *file_loader_thread_worker(void *arg);
+const char *io_backend_name(int backend);
+void run_io_benchmark(FileLoader *loader);
+int run_watch_mode(char *directories[], int directory_count, int backend, int read_ahead, int thread_count, int debounce_ms);
+#ifdef HAVE_INOTIFY
+int watch_add_directory(WatchState *state, const char *path);
+WatchedFile *watch_find_file(WatchState *state, const char *path);
+int watch_track_file(WatchState *state, const char *path);
+int watch_refresh(WatchState *state, int backend, int read_ahead, int thread_count);
+int watch_write_report(WatchState *state, const char *output_filename);
+int watch_handle_events(WatchState *state);
+#endif
+#ifdef HAVE_IO_URING
+void *file_loader_uring_worker(void *arg);
+#endif
 int calculate_cyclomatic_complexity(FileLine lines[], int total_lines);
+CloneIndex *clone_index_start(char *filenames[], int file_count, int thread_count, size_t budget, int max_copies);
+void clone_index_submit(CloneIndex *index, int file_id, FileLine *lines, int total_lines);
+void clone_index_finish(CloneIndex *index, FILE *output_file);
+int tokenize_lines(FileLine lines[], int total_lines, CloneToken **tokens_out);
+int next_source_token(const FileLine *line, int *position, int *in_block_comment, SourceToken *token);
+int declaration_pass_init(DeclarationPass *pass, int is_cpp);
+void declaration_pass_free(DeclarationPass *pass);
+void run_declaration_pass(DeclarationPass *pass, FileLine lines[], int total_lines);
+size_t winnow_tokens(CloneToken tokens[], int token_count, int file_id, CloneFingerprint **fingerprints_out);
+void clone_shard_insert(CloneShard *shard, CloneFingerprint fingerprints[], size_t count, size_t budget);
+void *clone_worker(void *arg);
+void report_clones(CloneIndex *index, FILE *output_file);
 
-// Function to process a single file
-// Function to process a single file
-void analyze_file(const char *input_filename, FILE *output_file) {
+// Store that findings are recorded into while the analysis runs (NULL when not recording)
+static FindingStore *active_findings = NULL;
+static int active_file_id = -1;
+static const FileLine *active_lines = NULL; // Lines of the active file, to hash the line of each finding
+static int active_line_count = 0;
+
+// Function to determine the file type from its extension (1 = C++, 0 = C, -1 = unsupported)
+int detect_file_type(const char *filename) {
+    if (strstr(filename, ".cpp") != NULL) {
+        return 1;
+    } else if (strstr(filename, ".c") != NULL) {
+        return 0;
+    }
+    return -1;
+}
+
+// Function to read a whole file into memory
+// Returns 0 on success, -1 if the file could not be opened or read, -2 if memory allocation failed
+int read_file_contents(const char *filename, char **data_out, size_t *size_out) {
     FILE *input_file;
+    char *data, *resized;
+    size_t size = 0, capacity = 4096, count;
+
+    input_file = fopen(filename, "rb");
+    if (input_file == NULL) {
+        return -1;
+    }
+
+    data = (char *)malloc(capacity);
+    if (data == NULL) {
+        fclose(input_file);
+        return -2;
+    }
+
+    while ((count = fread(data + size, 1, capacity - size, input_file)) > 0) {
+        size += count;
+        if (size == capacity) {
+            capacity *= 2;
+            resized = (char *)realloc(data, capacity);
+            if (resized == NULL) {
+                free(data);
+                fclose(input_file);
+                return -2;
+            }
+            data = resized;
+        }
+    }
+    if (ferror(input_file)) {
+        free(data);
+        fclose(input_file);
+        return -1;
+    }
+
+    fclose(input_file);
+
+    *data_out = data;
+    *size_out = size;
+    return 0;
+}
+
+// Function to split file contents into non-empty lines with comments stripped
+// Lines longer than the line buffer are split, the same way fgets would split them
+// Returns 0 on success, -2 if memory allocation failed
+int parse_file_lines(const char *data, size_t size, FileLine **lines_out, int *total_out) {
     FileLine *lines = NULL;
+    FileLine *resized;
     char buffer[1024];
-    int total_lines = 0, line_length, comment_position;
-    int is_cpp = 0;
+    size_t position = 0;
+    int total_lines = 0, source_line = 1, line_length, comment_position;
     int capacity = 100;  // Initial capacity
 
     lines = (FileLine *)malloc(capacity * sizeof(FileLine));
     if (lines == NULL) {
-        fprintf(output_file, "Error: Memory allocation failed.\n");
-        return;
+        return -2;
     }
 
-    // Determine file type based on extension
-    if (strstr(input_filename, ".cpp") != NULL) {
-        is_cpp = 1;
-    } else if (strstr(input_filename, ".c") == NULL) {
-        fprintf(output_file, "Error: Unsupported file extension for file %s. Please use .c or .cpp files.\n", input_filename);
-        free(lines);
-        return;
-    }
+    while (position < size) {
+        int line_number = source_line;
 
-    input_file = fopen(input_filename, "r");
-    if (input_file == NULL) {
-        fprintf(output_file, "Error: Could not open input file %s.\n", input_filename);
-        free(lines);
-        return;
-    }
+        // Copy the next line (or the next buffer-sized piece of it)
+        line_length = 0;
+        while (position < size && line_length < (int)sizeof(buffer) - 1) {
+            buffer[line_length++] = data[position++];
+            if (buffer[line_length - 1] == '\n') {
+                source_line++;
+                break;
+            }
+        }
+        buffer[line_length] = '\0';
+
+#ifdef _WIN32
+        // Text mode reads turn Windows line endings into newlines, so the binary contents must match
+        if (line_length >= 2 && buffer[line_length - 2] == '\r' && buffer[line_length - 1] == '\n') {
+            buffer[line_length - 2] = '\n';
+            buffer[line_length - 1] = '\0';
+        }
+#endif
 
-    // Read lines from the input file
-    while (fgets(buffer, sizeof(buffer), input_file) != NULL) {
         if (total_lines >= capacity) {
             capacity *= 2;
-            lines = (FileLine *)realloc(lines, capacity * sizeof(FileLine));
-            if (lines == NULL) {
-                fprintf(output_file, "Error: Memory reallocation failed.\n");
-                fclose(input_file);
-                return;
+            resized = (FileLine *)realloc(lines, capacity * sizeof(FileLine));
+            if (resized == NULL) {
+                free(lines);
+                return -2;
             }
+            lines = resized;
         }
 
         line_length = strlen(buffer); // Get the length of the line
@@ -91,12 +566,12 @@ void analyze_file(const char *input_filename, FILE *output_file) {
 
         // Process the line based on the presence of comments
         if (buffer[0] != '\n' && comment_position == -1) {
-            lines[total_lines].line_number = total_lines + 1;
+            lines[total_lines].line_number = line_number;
             lines[total_lines].line_length = line_length;
             strcpy(lines[total_lines].line_text, buffer);
             total_lines++;
         } else if (buffer[0] != '\n' && comment_position != -1) {
-            lines[total_lines].line_number = total_lines + 1;
+            lines[total_lines].line_number = line_number;
             strncpy(lines[total_lines].line_text, buffer, comment_position);
             lines[total_lines].line_text[comment_position] = '\0';
             lines[total_lines].line_length = comment_position;
@@ -104,9 +579,39 @@ void analyze_file(const char *input_filename, FILE *output_file) {
         }
     }
 
-    fclose(input_file);
+    *lines_out = lines;
+    *total_out = total_lines;
+    return 0;
+}
+
+// Function to process a single file whose contents have already been loaded
+// When lines_out is set, the parsed lines are handed to the caller instead of being freed (NULL if none were parsed)
+void analyze_loaded_file(const char *input_filename, const LoadedFile *loaded, FILE *output_file, FileLine **lines_out, int *total_out) {
+    FileLine *lines = NULL;
+    int total_lines = 0;
+    int is_cpp, status;
+
+    // Determine file type based on extension
+    is_cpp = detect_file_type(input_filename);
+    if (is_cpp < 0) {
+        fprintf(output_file, "Error: Unsupported file extension for file %s. Please use .c or .cpp files.\n", input_filename);
+        return;
+    }
+
+    status = loaded->status;
+    if (status == 0) {
+        status = parse_file_lines(loaded->data, loaded->size, &lines, &total_lines);
+    }
+    if (status == -1) {
+        fprintf(output_file, "Error: Could not open input file %s.\n", input_filename);
+        return;
+    } else if (status == -2) {
+        fprintf(output_file, "Error: Memory allocation failed.\n");
+        return;
+    }
 
     // Perform various checks and write results to the output file
+    set_active_finding_file(input_filename, lines, total_lines);
     fprintf(output_file, "Analysis for file: %s\n", input_filename);
     print_lines(lines, total_lines, output_file);
     check_brackets(lines, total_lines, output_file);
@@ -115,7 +620,7 @@ void analyze_file(const char *input_filename, FILE *output_file) {
     check_keyword_usage(lines, total_lines, output_file, is_cpp);
     check_builtin_functions(lines, total_lines, output_file, is_cpp);
     check_print_scan_functions(lines, total_lines, output_file);
-    count_variables(lines, total_lines, output_file);
+    count_variables(lines, total_lines, output_file, is_cpp);
     check_file_operations(lines, total_lines, output_file);
     check_semicolons(lines, total_lines, output_file);
 
@@ -128,28 +633,228 @@ void analyze_file(const char *input_filename, FILE *output_file) {
 
     fprintf(output_file, "\n");
 
+    if (lines_out != NULL) {
+        *lines_out = lines;
+        *total_out = total_lines;
+        return;
+    }
     // Free allocated memory
     free(lines);
 }
 
+// Function to process a single file
+void analyze_file(const char *input_filename, FILE *output_file) {
+    LoadedFile loaded = {0};
+
+    if (detect_file_type(input_filename) >= 0) {
+        loaded.status = read_file_contents(input_filename, &loaded.data, &loaded.size);
+    }
+    analyze_loaded_file(input_filename, &loaded, output_file, NULL, NULL);
+    free(loaded.data);
+}
+
+// Function to print the command line usage
+void print_usage(const char *program_name) {
+    printf("Usage: %s [options] <source_file1> <source_file2> ... <source_fileN>\n", program_name);
+    printf("       %s query <findings_store> checks | files | top [n]\n", program_name);
+    printf("       %s diff <old_findings_store> <new_findings_store>\n", program_name);
+    printf("Options:\n");
+    printf("  --clones            Detect duplicated code blocks across all input files\n");
+    printf("  --threads <n>       Number of worker threads (default: number of CPUs)\n");
+    printf("  --clone-budget <n>  Maximum number of fingerprints kept in the clone index (default: %d)\n", CLONE_DEFAULT_BUDGET);
+    printf("  --clone-max-copies <n>\n");
+    printf("                      Only count blocks copied more than n times, as boilerplate (default: list all)\n");
+    printf("  --io <backend>      File loading backend: auto, uring, threads or stdio (default: auto)\n");
+    printf("  --read-ahead <n>    Number of files loaded ahead of the analysis (default: %d)\n", DEFAULT_READ_AHEAD);
+    printf("  --io-bench          Only load the files and report the loading throughput\n");
+    printf("  --watch             Treat the arguments as directories, analyze every .c/.cpp file in them\n");
+    printf("                      and keep output.txt up to date as files are saved (Linux only)\n");
+    printf("                      (cannot be combined with --clones, --findings or --io-bench)\n");
+    printf("  --findings <path>   Also save the findings to a compact binary store for query and diff\n");
+    printf("  --debounce <ms>     Quiet time after the last change before re-analyzing in watch mode (default: %d)\n", WATCH_DEBOUNCE_MS);
+}
+
 int main(int argc, char *argv[]) {
-    if (argc < 2) {
-        printf("Usage: %s <source_file1> <source_file2> ... <source_fileN>\n", argv[0]);
+    char **input_files;
+    int input_count = 0;
+    int find_clones = 0;
+    int thread_count = DEFAULT_THREADS;
+    size_t clone_budget = CLONE_DEFAULT_BUDGET;
+    int clone_max_copies = 0;
+    int io_backend = IO_BACKEND_AUTO;
+    int read_ahead = DEFAULT_READ_AHEAD;
+    int io_bench = 0;
+    int watch = 0;
+    int debounce_ms = WATCH_DEBOUNCE_MS;
+    const char *findings_filename = NULL;
+    FindingStore findings;
+    CloneIndex *clones = NULL;
+    FileLoader loader;
+
+    // Subcommands working on saved findings
+    if (argc >= 2 && strcmp(argv[1], "query") == 0) {
+        return run_findings_query(argc - 2, argv + 2);
+    }
+    if (argc >= 2 && strcmp(argv[1], "diff") == 0) {
+        return run_findings_diff(argc - 2, argv + 2);
+    }
+
+#ifdef _SC_NPROCESSORS_ONLN
+    long cpu_count = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpu_count > 0) {
+        thread_count = (int)cpu_count;
+    }
+#endif
+
+    input_files = (char **)malloc(argc * sizeof(char *));
+    if (input_files == NULL) {
+        printf("Error: Memory allocation failed.\n");
+        return 1;
+    }
+
+    // Separate options from the list of source files
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--clones") == 0) {
+            find_clones = 1;
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            thread_count = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--clone-budget") == 0 && i + 1 < argc) {
+            clone_budget = (size_t)strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--clone-max-copies") == 0 && i + 1 < argc) {
+            clone_max_copies = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--io") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "auto") == 0) {
+                io_backend = IO_BACKEND_AUTO;
+            } else if (strcmp(argv[i], "uring") == 0) {
+                io_backend = IO_BACKEND_URING;
+            } else if (strcmp(argv[i], "threads") == 0) {
+                io_backend = IO_BACKEND_THREADS;
+            } else if (strcmp(argv[i], "stdio") == 0) {
+                io_backend = IO_BACKEND_STDIO;
+            } else {
+                printf("Error: Unknown I/O backend %s.\n", argv[i]);
+                free(input_files);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--read-ahead") == 0 && i + 1 < argc) {
+            read_ahead = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--io-bench") == 0) {
+            io_bench = 1;
+        } else if (strcmp(argv[i], "--watch") == 0) {
+            watch = 1;
+        } else if (strcmp(argv[i], "--debounce") == 0 && i + 1 < argc) {
+            debounce_ms = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--findings") == 0 && i + 1 < argc) {
+            findings_filename = argv[++i];
+        } else if (strncmp(argv[i], "--", 2) == 0) {
+            printf("Error: Unknown or incomplete option %s.\n", argv[i]);
+            print_usage(argv[0]);
+            free(input_files);
+            return 1;
+        } else {
+            input_files[input_count++] = argv[i];
+        }
+    }
+
+    if (input_count < 1) {
+        print_usage(argv[0]);
+        free(input_files);
+        return 1;
+    }
+    if (thread_count < 1) {
+        thread_count = 1;
+    }
+    if (read_ahead < 1 || read_ahead > 16384) {
+        read_ahead = DEFAULT_READ_AHEAD;
+    }
+    if (debounce_ms < 0) {
+        debounce_ms = WATCH_DEBOUNCE_MS;
+    }
+
+    if (watch) {
+        int result;
+        // Watch mode keeps only the report up to date; it has no whole-run clone index or findings store
+        if (find_clones || findings_filename != NULL || io_bench) {
+            printf("Error: --watch cannot be combined with --clones, --findings or --io-bench.\n");
+            free(input_files);
+            return 1;
+        }
+        result = run_watch_mode(input_files, input_count, io_backend, read_ahead, thread_count, debounce_ms);
+        free(input_files);
+        return result;
+    }
+
+    if (file_loader_start(&loader, input_files, input_count, io_backend, read_ahead, thread_count) != 0) {
+        printf("Error: Memory allocation failed.\n");
+        free(input_files);
         return 1;
     }
 
+    if (io_bench) {
+        run_io_benchmark(&loader);
+        file_loader_finish(&loader);
+        free(input_files);
+        return 0;
+    }
+
     FILE *output_file = fopen("output.txt", "w");
     if (output_file == NULL) {
         printf("Error: Could not open output file.\n");
+        file_loader_finish(&loader);
+        free(input_files);
         return 1;
     }
 
-    // Process each file passed as an argument
-    for (int i = 1; i < argc; i++) {
-        analyze_file(argv[i], output_file);
+    if (findings_filename != NULL) {
+        if (finding_store_init(&findings) != 0) {
+            printf("Error: Memory allocation failed.\n");
+            fclose(output_file);
+            file_loader_finish(&loader);
+            free(input_files);
+            return 1;
+        }
+        active_findings = &findings;
+    }
+
+    // Clone detection fingerprints the lines the analysis has already parsed, on its own threads
+    if (find_clones) {
+        clones = clone_index_start(input_files, input_count, thread_count, clone_budget, clone_max_copies);
+        if (clones == NULL) {
+            fprintf(output_file, "Error: Memory allocation failed.\n");
+        }
+    }
+
+    // Process each file passed as an argument, in order, while the loader reads ahead
+    for (int i = 0; i < input_count; i++) {
+        FileLine *lines = NULL;
+        int total_lines = 0;
+
+        analyze_loaded_file(input_files[i], file_loader_wait(&loader, i), output_file,
+                            clones != NULL ? &lines : NULL, &total_lines);
+        file_loader_release(&loader, i);
+        if (clones != NULL) {
+            clone_index_submit(clones, i, lines, total_lines);
+        }
+    }
+    file_loader_finish(&loader);
+
+    if (clones != NULL) {
+        clone_index_finish(clones, output_file);
     }
 
     fclose(output_file);
+    free(input_files);
+
+    if (findings_filename != NULL) {
+        active_findings = NULL;
+        if (finding_store_write(&findings, findings_filename) != 0) {
+            printf("Error: Could not write findings store %s.\n", findings_filename);
+            finding_store_free(&findings);
+            return 1;
+        }
+        finding_store_free(&findings);
+    }
 
     return 0;
 }
@@ -182,6 +887,7 @@ void check_brackets(FileLine lines[], int total_lines, FILE *output_file) {
     }
     if (open_brackets != close_brackets) {
         fprintf(output_file, "Error: Mismatched brackets detected.\n");
+        record_finding(0, CHECK_BRACKETS, "Mismatched brackets detected");
     } else {
         fprintf(output_file, "Brackets are balanced.\n");
     }
@@ -197,13 +903,13 @@ void check_keywords(FileLine lines[], int total_lines, FILE *output_file, int is
     for (int i = 0; i < total_lines; i++) {
         for (int j = 0; j < keyword_count_c; j++) {
             if (strstr(lines[i].line_text, keywords_c[j])) {
-                fprintf(output_file, "Line %d: Found keyword '%s'\n", lines[i].line_number, keywords_c[j]);
+                report_finding(output_file, lines[i].line_number, CHECK_KEYWORD, "Found keyword '%s'", keywords_c[j]);
             }
         }
         if (is_cpp) {
             for (int j = 0; j < keyword_count_cpp; j++) {
                 if (strstr(lines[i].line_text, keywords_cpp[j])) {
-                    fprintf(output_file, "Line %d: Found keyword '%s'\n", lines[i].line_number, keywords_cpp[j]);
+                    report_finding(output_file, lines[i].line_number, CHECK_KEYWORD, "Found keyword '%s'", keywords_cpp[j]);
                 }
             }
         }
@@ -232,10 +938,10 @@ void count_functions_and_prototypes(FileLine lines[], int total_lines, FILE *out
 void check_keyword_usage(FileLine lines[], int total_lines, FILE *output_file, int is_cpp) {
     for (int i = 0; i < total_lines; i++) {
         if (is_for_loop(lines[i].line_text, lines[i].line_length)) {
-            fprintf(output_file, "Line %d: Contains a for loop\n", lines[i].line_number);
+            report_finding(output_file, lines[i].line_number, CHECK_LOOP, "Contains a for loop");
         }
         if (is_while_loop(lines[i].line_text, lines[i].line_length)) {
-            fprintf(output_file, "Line %d: Contains a while loop\n", lines[i].line_number);
+            report_finding(output_file, lines[i].line_number, CHECK_LOOP, "Contains a while loop");
         }
     }
 }
@@ -250,13 +956,13 @@ void check_builtin_functions(FileLine lines[], int total_lines, FILE *output_fil
     for (int i = 0; i < total_lines; i++) {
         for (int j = 0; j < function_count_c; j++) {
             if (strstr(lines[i].line_text, builtin_functions_c[j])) {
-                fprintf(output_file, "Line %d: Found built-in function usage '%s'\n", lines[i].line_number, builtin_functions_c[j]);
+                report_finding(output_file, lines[i].line_number, CHECK_BUILTIN, "Found built-in function usage '%s'", builtin_functions_c[j]);
             }
         }
         if (is_cpp) {
             for (int j = 0; j < function_count_cpp; j++) {
                 if (strstr(lines[i].line_text, builtin_functions_cpp[j])) {
-                    fprintf(output_file, "Line %d: Found built-in function usage '%s'\n", lines[i].line_number, builtin_functions_cpp[j]);
+                    report_finding(output_file, lines[i].line_number, CHECK_BUILTIN, "Found built-in function usage '%s'", builtin_functions_cpp[j]);
                 }
             }
         }
@@ -268,10 +974,10 @@ void check_builtin_functions(FileLine lines[], int total_lines, FILE *output_fil
 void check_print_scan_functions(FileLine lines[], int total_lines, FILE *output_file) {
     for (int i = 0; i < total_lines; i++) {
         if (is_print_function(lines[i].line_text, lines[i].line_length)) {
-            fprintf(output_file, "Line %d: Contains a print function\n", lines[i].line_number);
+            report_finding(output_file, lines[i].line_number, CHECK_PRINT_SCAN, "Contains a print function");
         }
         if (is_scan_function(lines[i].line_text, lines[i].line_length)) {
-            fprintf(output_file, "Line %d: Contains a scan function\n", lines[i].line_number);
+            report_finding(output_file, lines[i].line_number, CHECK_PRINT_SCAN, "Contains a scan function");
         }
     }
 }
@@ -292,31 +998,68 @@ int is_scan_function(char line[], int line_length) {
     return 0;
 }
 
-// Function to count the number of variables
-void count_variables(FileLine lines[], int total_lines, FILE *output_file) {
-    const char *data_types[] = {"int", "float", "double", "char"};
-    int data_type_count = sizeof(data_types) / sizeof(data_types[0]);
-    int variable_count = 0;
+// Function to order declaration findings by line, keeping the order they were found in otherwise
+static int compare_declaration_findings(const void *a, const void *b) {
+    const DeclarationFinding *x = (const DeclarationFinding *)a;
+    const DeclarationFinding *y = (const DeclarationFinding *)b;
+    if (x->line_number != y->line_number) return x->line_number < y->line_number ? -1 : 1;
+    return (x->order > y->order) - (x->order < y->order);
+}
 
-    for (int i = 0; i < total_lines; i++) {
-        for (int j = 0; j < data_type_count; j++) {
-            if (strstr(lines[i].line_text, data_types[j])) {
-                variable_count++;
-                break;
-            }
+// Function to count the declared variables and report unused and shadowing declarations
+void count_variables(FileLine lines[], int total_lines, FILE *output_file, int is_cpp) {
+    DeclarationPass pass;
+
+    if (declaration_pass_init(&pass, is_cpp) != 0) {
+        fprintf(output_file, "Error: Memory allocation failed.\n");
+        return;
+    }
+    run_declaration_pass(&pass, lines, total_lines);
+    if (pass.failed) {
+        declaration_pass_free(&pass);
+        fprintf(output_file, "Error: Memory allocation failed.\n");
+        return;
+    }
+
+    fprintf(output_file, "Number of variables: %d\n", pass.variable_count);
+    fprintf(output_file, "Number of parameters: %d\n", pass.parameter_count);
+
+    if (pass.finding_count > 0) {
+        qsort(pass.findings, pass.finding_count, sizeof(DeclarationFinding), compare_declaration_findings);
+    }
+    for (int i = 0; i < pass.finding_count; i++) {
+        DeclarationFinding *finding = &pass.findings[i];
+        const char *name = string_table_get(&pass.names, finding->name_id);
+        if (finding->check_id == CHECK_UNUSED) {
+            report_finding(output_file, finding->line_number, CHECK_UNUSED, "Unused %s '%s'",
+                           finding->detail == DECLARATION_PARAMETER ? "parameter" : "variable", name);
+        } else {
+            // The line of the outer declaration is only printed, so a diff still matches the finding after edits above it
+            char message[1024];
+            snprintf(message, sizeof(message), "Declaration of '%s' shadows an outer declaration", name);
+            fprintf(output_file, "Line %d: Declaration of '%s' shadows the one on line %d\n", finding->line_number, name, finding->detail);
+            record_finding(finding->line_number, CHECK_SHADOW, message);
         }
     }
-    fprintf(output_file, "Number of variables: %d\n", variable_count);
+
+    for (int i = 0; i < pass.function_count; i++) {
+        FunctionDeclarations *function = &pass.functions[i];
+        fprintf(output_file, "Function %s (line %d): %d declarations (%d parameters, %d locals)\n",
+                string_table_get(&pass.names, function->name_id), function->line_number,
+                function->parameters + function->locals, function->parameters, function->locals);
+    }
+
+    declaration_pass_free(&pass);
 }
 
 // Function to check file operations
 void check_file_operations(FileLine lines[], int total_lines, FILE *output_file) {
     for (int i = 0; i < total_lines; i++) {
         if (strstr(lines[i].line_text, "fopen")) {
-            fprintf(output_file, "Line %d: Contains a file open operation\n", lines[i].line_number);
+            report_finding(output_file, lines[i].line_number, CHECK_FILE_OPERATION, "Contains a file open operation");
         }
         if (strstr(lines[i].line_text, "fclose")) {
-            fprintf(output_file, "Line %d: Contains a file close operation\n", lines[i].line_number);
+            report_finding(output_file, lines[i].line_number, CHECK_FILE_OPERATION, "Contains a file close operation");
         }
     }
 }
@@ -362,7 +1105,7 @@ int is_valid_variable_declaration(char *line) {
 void check_semicolons(FileLine lines[], int total_lines, FILE *output_file) {
     for (int i = 0; i < total_lines; i++) {
         if (!strchr(lines[i].line_text, ';') && !strstr(lines[i].line_text, "for") && !strstr(lines[i].line_text, "while") && !strstr(lines[i].line_text, "{") && !strstr(lines[i].line_text, "}")) {
-            fprintf(output_file, "Line %d: Missing semicolon\n", lines[i].line_number);
+            report_finding(output_file, lines[i].line_number, CHECK_SEMICOLON, "Missing semicolon");
         }
     }
 }
@@ -377,7 +1120,7 @@ void check_cpp_specific_constructs(FileLine lines[], int total_lines, FILE *outp
 void check_class_usage(FileLine lines[], int total_lines, FILE *output_file) {
     for (int i = 0; i < total_lines; i++) {
         if (strstr(lines[i].line_text, "class")) {
-            fprintf(output_file, "Line %d: Contains class declaration\n", lines[i].line_number);
+            report_finding(output_file, lines[i].line_number, CHECK_CLASS, "Contains class declaration");
         }
     }
 }
@@ -386,7 +1129,7 @@ void check_class_usage(FileLine lines[], int total_lines, FILE *output_file) {
 void check_templates(FileLine lines[], int total_lines, FILE *output_file) {
     for (int i = 0; i < total_lines; i++) {
         if (strstr(lines[i].line_text, "template")) {
-            fprintf(output_file, "Line %d: Contains template usage\n", lines[i].line_number);
+            report_finding(output_file, lines[i].line_number, CHECK_TEMPLATE, "Contains template usage");
         }
     }
 }
@@ -403,4 +1146,3467 @@ int calculate_cyclomatic_complexity(FileLine lines[], int total_lines) {
         }
     }
     return complexity;
-}
\ No newline at end of file
+}
+
+// Function to hash a token's text (FNV-1a)
+static uint64_t hash_token_text(const char *text, int length) {
+    uint64_t hash = 1469598103934665603ULL;
+    for (int i = 0; i < length; i++) {
+        hash ^= (unsigned char)text[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// Function to check if a word is a C/C++ keyword that should survive normalization
+static int is_clone_keyword(const char *word, int length) {
+    static const char *keywords[] = {
+        "auto", "break", "case", "char", "class", "const", "continue", "default", "delete", "do",
+        "double", "else", "enum", "extern", "float", "for", "goto", "if", "inline", "int", "long",
+        "namespace", "new", "private", "protected", "public", "register", "return", "short",
+        "signed", "sizeof", "static", "struct", "switch", "template", "this", "typedef",
+        "union", "unsigned", "virtual", "void", "volatile", "while"
+    };
+    int keyword_count = sizeof(keywords) / sizeof(keywords[0]);
+
+    for (int i = 0; i < keyword_count; i++) {
+        if ((int)strlen(keywords[i]) == length && strncmp(word, keywords[i], length) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Function to check if a line is a preprocessor directive
+static int is_preprocessor_line(const FileLine *line) {
+    int j = 0;
+    while (j < line->line_length && isspace((unsigned char)line->line_text[j])) j++;
+    return j < line->line_length && line->line_text[j] == '#';
+}
+
+// Function to scan the next token of a line, skipping whitespace and block comments
+// Returns 1 if a token was found, 0 at the end of the line
+int next_source_token(const FileLine *line, int *position, int *in_block_comment, SourceToken *token) {
+    const char *text = line->line_text;
+    int length = line->line_length;
+    int j = *position;
+
+    while (j < length) {
+        unsigned char c = (unsigned char)text[j];
+        int start = j;
+
+        if (*in_block_comment) {
+            if (c == '*' && j + 1 < length && text[j + 1] == '/') {
+                *in_block_comment = 0;
+                j += 2;
+            } else {
+                j++;
+            }
+            continue;
+        }
+        if (isspace(c)) {
+            j++;
+            continue;
+        }
+        if (c == '/' && j + 1 < length && text[j + 1] == '*') {
+            *in_block_comment = 1;
+            j += 2;
+            continue;
+        }
+
+        if (isalpha(c) || c == '_') {
+            while (j < length && (isalnum((unsigned char)text[j]) || text[j] == '_')) j++;
+            token->kind = TOKEN_IDENTIFIER;
+        } else if (isdigit(c)) {
+            while (j < length && (isalnum((unsigned char)text[j]) || text[j] == '.')) j++;
+            token->kind = TOKEN_NUMBER;
+        } else if (c == '"' || c == '\'') {
+            j++;
+            while (j < length && text[j] != (char)c) {
+                if (text[j] == '\\') j++;
+                j++;
+            }
+            j++;
+            if (j > length) j = length;
+            token->kind = TOKEN_LITERAL;
+        } else {
+            j++;
+            token->kind = TOKEN_PUNCTUATION;
+        }
+        token->text = text + start;
+        token->length = j - start;
+        token->line_number = line->line_number;
+        *position = j;
+        return 1;
+    }
+    *position = j;
+    return 0;
+}
+
+// Function to turn the loaded lines into normalized tokens
+// Identifiers, numbers and string/char literals are abstracted so renamed copies still match
+int tokenize_lines(FileLine lines[], int total_lines, CloneToken **tokens_out) {
+    const uint64_t identifier_hash = hash_token_text("$id", 3);
+    const uint64_t number_hash = hash_token_text("$num", 4);
+    const uint64_t literal_hash = hash_token_text("$lit", 4);
+    CloneToken *tokens;
+    CloneToken *resized;
+    int token_count = 0, capacity = 256;
+    int in_block_comment = 0;
+
+    tokens = (CloneToken *)malloc(capacity * sizeof(CloneToken));
+    if (tokens == NULL) {
+        return -1;
+    }
+
+    for (int i = 0; i < total_lines; i++) {
+        SourceToken token;
+        int position = 0;
+
+        // Preprocessor directives carry no clone-relevant structure
+        if (!in_block_comment && is_preprocessor_line(&lines[i])) {
+            continue;
+        }
+
+        while (next_source_token(&lines[i], &position, &in_block_comment, &token)) {
+            uint64_t hash;
+
+            if (token.kind == TOKEN_IDENTIFIER) {
+                hash = is_clone_keyword(token.text, token.length) ? hash_token_text(token.text, token.length) : identifier_hash;
+            } else if (token.kind == TOKEN_NUMBER) {
+                hash = number_hash;
+            } else if (token.kind == TOKEN_LITERAL) {
+                hash = literal_hash;
+            } else {
+                hash = hash_token_text(token.text, 1);
+            }
+
+            if (token_count >= capacity) {
+                capacity *= 2;
+                resized = (CloneToken *)realloc(tokens, capacity * sizeof(CloneToken));
+                if (resized == NULL) {
+                    free(tokens);
+                    return -1;
+                }
+                tokens = resized;
+            }
+            tokens[token_count].hash = hash;
+            tokens[token_count].line_number = token.line_number;
+            token_count++;
+        }
+    }
+
+    *tokens_out = tokens;
+    return token_count;
+}
+
+// Function to fingerprint a token stream with rolling k-gram hashes and winnowing
+// Returns the number of fingerprints selected, or 0 if there was nothing to select
+size_t winnow_tokens(CloneToken tokens[], int token_count, int file_id, CloneFingerprint **fingerprints_out) {
+    const uint64_t base = 1000003ULL;
+    uint64_t base_power = 1, rolling = 0;
+    uint64_t *kgram_hashes;
+    int *window;
+    CloneFingerprint *fingerprints;
+    int kgram_count, window_size, head = 0, tail = 0, last_selected = -1;
+    size_t selected = 0, capacity;
+
+    *fingerprints_out = NULL;
+    if (token_count < CLONE_KGRAM) {
+        return 0;
+    }
+
+    kgram_count = token_count - CLONE_KGRAM + 1;
+    window_size = kgram_count < CLONE_WINDOW ? kgram_count : CLONE_WINDOW;
+    kgram_hashes = (uint64_t *)malloc(kgram_count * sizeof(uint64_t));
+    window = (int *)malloc(kgram_count * sizeof(int));
+    // Winnowing selects about 2 / (window + 1) of the k-grams on typical input
+    capacity = (size_t)kgram_count / window_size * 2 + 16;
+    fingerprints = (CloneFingerprint *)malloc(capacity * sizeof(CloneFingerprint));
+    if (kgram_hashes == NULL || window == NULL || fingerprints == NULL) {
+        free(kgram_hashes);
+        free(window);
+        free(fingerprints);
+        return 0;
+    }
+
+    // Rolling polynomial hash over each window of CLONE_KGRAM tokens
+    for (int i = 0; i < CLONE_KGRAM - 1; i++) {
+        base_power *= base;
+    }
+    for (int i = 0; i < token_count; i++) {
+        if (i >= CLONE_KGRAM) {
+            rolling -= tokens[i - CLONE_KGRAM].hash * base_power;
+        }
+        rolling = rolling * base + tokens[i].hash;
+        if (i >= CLONE_KGRAM - 1) {
+            // Mix the bits so the shard and sampling selectors see a uniform distribution
+            uint64_t mixed = rolling;
+            mixed ^= mixed >> 33;
+            mixed *= 0xff51afd7ed558ccdULL;
+            mixed ^= mixed >> 33;
+            kgram_hashes[i - CLONE_KGRAM + 1] = mixed;
+        }
+    }
+
+    // Winnowing: keep the rightmost minimum of every window, using a monotonic queue
+    for (int i = 0; i < kgram_count; i++) {
+        while (tail > head && kgram_hashes[window[tail - 1]] >= kgram_hashes[i]) tail--;
+        window[tail++] = i;
+        if (window[head] <= i - window_size) head++;
+
+        if (i >= window_size - 1 && window[head] != last_selected) {
+            last_selected = window[head];
+            if (selected >= capacity) {
+                CloneFingerprint *resized = (CloneFingerprint *)realloc(fingerprints, capacity * 2 * sizeof(CloneFingerprint));
+                if (resized == NULL) break;
+                fingerprints = resized;
+                capacity *= 2;
+            }
+            fingerprints[selected].hash = kgram_hashes[last_selected];
+            fingerprints[selected].file_id = file_id;
+            fingerprints[selected].line_start = tokens[last_selected].line_number;
+            fingerprints[selected].line_end = tokens[last_selected + CLONE_KGRAM - 1].line_number;
+            selected++;
+        }
+    }
+
+    free(kgram_hashes);
+    free(window);
+    *fingerprints_out = fingerprints;
+    return selected;
+}
+
+// Function to order fingerprints by hash, then by location
+static int compare_fingerprints(const void *left, const void *right) {
+    const CloneFingerprint *a = (const CloneFingerprint *)left;
+    const CloneFingerprint *b = (const CloneFingerprint *)right;
+    if (a->hash != b->hash) return a->hash < b->hash ? -1 : 1;
+    if (a->file_id != b->file_id) return a->file_id - b->file_id;
+    return a->line_start - b->line_start;
+}
+
+// Function to order clone pairs so that matches on the same line offset end up next to each other
+static int compare_clone_pairs(const void *left, const void *right) {
+    const ClonePair *a = (const ClonePair *)left;
+    const ClonePair *b = (const ClonePair *)right;
+    if (a->file_a != b->file_a) return a->file_a - b->file_a;
+    if (a->file_b != b->file_b) return a->file_b - b->file_b;
+    if (a->b_start - a->a_start != b->b_start - b->a_start) return (a->b_start - a->a_start) - (b->b_start - b->a_start);
+    if (a->a_start != b->a_start) return a->a_start - b->a_start;
+    return a->b_start - b->b_start;
+}
+
+// Function to add a batch of fingerprints to one shard of the index
+// When the shard reaches its budget, only every other remaining hash is kept from then on,
+// so memory stays bounded and both copies of a clone are still sampled the same way
+void clone_shard_insert(CloneShard *shard, CloneFingerprint fingerprints[], size_t count, size_t budget) {
+    pthread_mutex_lock(&shard->lock);
+    for (size_t i = 0; i < count; i++) {
+        if (fingerprints[i].hash & shard->sample_mask) {
+            continue;
+        }
+
+        while (shard->count >= budget && shard->sample_mask != UINT64_MAX) {
+            size_t kept = 0;
+            shard->sample_mask = (shard->sample_mask << 1) | 1;
+            for (size_t j = 0; j < shard->count; j++) {
+                if ((shard->entries[j].hash & shard->sample_mask) == 0) {
+                    shard->entries[kept++] = shard->entries[j];
+                }
+            }
+            shard->count = kept;
+        }
+        if ((fingerprints[i].hash & shard->sample_mask) || shard->count >= budget) {
+            continue;
+        }
+
+        if (shard->count >= shard->capacity) {
+            size_t new_capacity = shard->capacity ? shard->capacity * 2 : 1024;
+            CloneFingerprint *resized;
+            if (new_capacity > budget) new_capacity = budget;
+            resized = (CloneFingerprint *)realloc(shard->entries, new_capacity * sizeof(CloneFingerprint));
+            if (resized == NULL) break;
+            shard->entries = resized;
+            shard->capacity = new_capacity;
+        }
+        shard->entries[shard->count++] = fingerprints[i];
+    }
+    pthread_mutex_unlock(&shard->lock);
+}
+
+// Function run by each clone detection thread: tokenize and fingerprint files until none are left
+void *clone_worker(void *arg) {
+    CloneIndex *index = (CloneIndex *)arg;
+    int file_id;
+
+    while ((file_id = atomic_fetch_add(&index->next_file, 1)) < index->file_count) {
+        FileLine *lines;
+        CloneToken *tokens = NULL;
+        CloneFingerprint *fingerprints = NULL;
+        int total_lines, token_count;
+        size_t fingerprint_count, run_start = 0;
+
+        // Wait for the analysis to hand the file over
+        pthread_mutex_lock(&index->lock);
+        while (index->submitted <= file_id) {
+            pthread_cond_wait(&index->changed, &index->lock);
+        }
+        lines = index->lines[file_id];
+        total_lines = index->line_counts[file_id];
+        index->lines[file_id] = NULL;
+        pthread_mutex_unlock(&index->lock);
+        if (lines == NULL) {
+            continue;
+        }
+
+        token_count = tokenize_lines(lines, total_lines, &tokens);
+        free(lines);
+        if (token_count <= 0) {
+            free(tokens);
+            continue;
+        }
+
+        fingerprint_count = winnow_tokens(tokens, token_count, file_id, &fingerprints);
+        free(tokens);
+
+        // Sorting by hash groups the fingerprints by shard, so each shard is locked once per file
+        if (fingerprint_count > 0) {
+            qsort(fingerprints, fingerprint_count, sizeof(CloneFingerprint), compare_fingerprints);
+        }
+        for (size_t i = 1; i <= fingerprint_count; i++) {
+            if (i == fingerprint_count || fingerprints[i].hash >> 58 != fingerprints[run_start].hash >> 58) {
+                clone_shard_insert(&index->shards[fingerprints[run_start].hash >> 58],
+                                   fingerprints + run_start, i - run_start, index->shard_budget);
+                run_start = i;
+            }
+        }
+        free(fingerprints);
+    }
+    return NULL;
+}
+
+// Function to start the clone detection workers; the files are handed to them with clone_index_submit
+// Returns the index, or NULL if memory allocation failed
+CloneIndex *clone_index_start(char *filenames[], int file_count, int thread_count, size_t budget, int max_copies) {
+    CloneIndex *index;
+
+    index = (CloneIndex *)calloc(1, sizeof(CloneIndex));
+    if (index == NULL) {
+        return NULL;
+    }
+    index->lines = (FileLine **)calloc(file_count + 1, sizeof(FileLine *));
+    index->line_counts = (int *)calloc(file_count + 1, sizeof(int));
+    index->threads = (pthread_t *)malloc(thread_count * sizeof(pthread_t));
+    if (index->lines == NULL || index->line_counts == NULL || index->threads == NULL) {
+        free(index->lines);
+        free(index->line_counts);
+        free(index->threads);
+        free(index);
+        return NULL;
+    }
+
+    index->filenames = filenames;
+    index->file_count = file_count;
+    atomic_init(&index->next_file, 0);
+    index->shard_budget = budget / CLONE_SHARDS > 0 ? budget / CLONE_SHARDS : 1;
+    index->max_copies = max_copies;
+    pthread_mutex_init(&index->lock, NULL);
+    pthread_cond_init(&index->changed, NULL);
+    for (int i = 0; i < CLONE_SHARDS; i++) {
+        pthread_mutex_init(&index->shards[i].lock, NULL);
+    }
+
+    // Without any worker, clone_index_finish fingerprints the files on the calling thread
+    for (int i = 0; i < thread_count; i++) {
+        if (pthread_create(&index->threads[i], NULL, clone_worker, index) != 0) {
+            break;
+        }
+        index->thread_count++;
+    }
+    return index;
+}
+
+// Function to hand the parsed lines of the next file to the clone detection workers, which free them
+// Files must be submitted in order; lines is NULL for a file that could not be read
+void clone_index_submit(CloneIndex *index, int file_id, FileLine *lines, int total_lines) {
+    pthread_mutex_lock(&index->lock);
+    index->lines[file_id] = lines;
+    index->line_counts[file_id] = total_lines;
+    index->submitted = file_id + 1;
+    pthread_cond_broadcast(&index->changed);
+    pthread_mutex_unlock(&index->lock);
+}
+
+// Function to wait for the clone detection workers, report the clones they found and free the index
+void clone_index_finish(CloneIndex *index, FILE *output_file) {
+    pthread_mutex_lock(&index->lock);
+    index->submitted = index->file_count;
+    pthread_cond_broadcast(&index->changed);
+    pthread_mutex_unlock(&index->lock);
+
+    if (index->thread_count == 0) {
+        clone_worker(index);
+    }
+    for (int i = 0; i < index->thread_count; i++) {
+        pthread_join(index->threads[i], NULL);
+    }
+
+    report_clones(index, output_file);
+
+    for (int i = 0; i < CLONE_SHARDS; i++) {
+        pthread_mutex_destroy(&index->shards[i].lock);
+        free(index->shards[i].entries);
+    }
+    pthread_cond_destroy(&index->changed);
+    pthread_mutex_destroy(&index->lock);
+    free(index->lines);
+    free(index->line_counts);
+    free(index->threads);
+    free(index);
+}
+
+// Function to add a pair of matching line ranges to a growing array
+// Returns 0 on success, -2 if memory allocation failed
+static int add_clone_pair(ClonePair **pairs, size_t *count, size_t *capacity, const CloneFingerprint *x, const CloneFingerprint *y) {
+    if (*count >= *capacity) {
+        size_t new_capacity = *capacity ? *capacity * 2 : 1024;
+        ClonePair *resized = (ClonePair *)realloc(*pairs, new_capacity * sizeof(ClonePair));
+        if (resized == NULL) {
+            return -2;
+        }
+        *pairs = resized;
+        *capacity = new_capacity;
+    }
+    (*pairs)[*count].file_a = x->file_id;
+    (*pairs)[*count].a_start = x->line_start;
+    (*pairs)[*count].a_end = x->line_end;
+    (*pairs)[*count].file_b = y->file_id;
+    (*pairs)[*count].b_start = y->line_start;
+    (*pairs)[*count].b_end = y->line_end;
+    (*count)++;
+    return 0;
+}
+
+// Function to order merged clones by their first location, longest first, so copies of one block end up next to each other
+static int compare_clone_anchors(const void *left, const void *right) {
+    const ClonePair *a = (const ClonePair *)left;
+    const ClonePair *b = (const ClonePair *)right;
+    if (a->file_a != b->file_a) return a->file_a - b->file_a;
+    if (a->a_start != b->a_start) return a->a_start - b->a_start;
+    if (a->a_end != b->a_end) return b->a_end - a->a_end;
+    if (a->file_b != b->file_b) return a->file_b - b->file_b;
+    return a->b_start - b->b_start;
+}
+
+// Function to order the copies of a clone class by file and line
+static int compare_clone_locations(const void *left, const void *right) {
+    const CloneLocation *a = (const CloneLocation *)left;
+    const CloneLocation *b = (const CloneLocation *)right;
+    if (a->file_id != b->file_id) return a->file_id - b->file_id;
+    return a->line_start - b->line_start;
+}
+
+// Function to print one clone class and record a finding for each of its copies; locations[0] is the first copy
+// Returns 1 if the class was reported, 0 if a single copy is left, -1 if it has more copies than the boilerplate limit
+static int report_clone_class(CloneIndex *index, CloneLocation locations[], int count, FILE *output_file) {
+    int kept = 1, lines = locations[0].line_end - locations[0].line_start + 1;
+
+    // Copies found through several fingerprint offsets overlap; keep one range per copy
+    qsort(locations, count, sizeof(CloneLocation), compare_clone_locations);
+    for (int i = 1; i < count; i++) {
+        CloneLocation *last = &locations[kept - 1];
+        if (locations[i].file_id == last->file_id && locations[i].line_start <= last->line_end) {
+            if (locations[i].line_end > last->line_end) last->line_end = locations[i].line_end;
+            continue;
+        }
+        locations[kept++] = locations[i];
+    }
+    if (kept < 2) {
+        return 0;
+    }
+    if (index->max_copies > 0 && kept > index->max_copies) {
+        return -1;
+    }
+
+    fprintf(output_file, "Clone: %d copies of %d lines\n", kept, lines);
+    for (int i = 0; i < kept; i++) {
+        fprintf(output_file, "    %s lines %d-%d\n", index->filenames[locations[i].file_id],
+                locations[i].line_start, locations[i].line_end);
+    }
+    // The stored message leaves the line ranges out, so a diff still matches the clone after edits above it
+    if (active_findings != NULL) {
+        char message[1024];
+        snprintf(message, sizeof(message), "Clone of %d lines, %d copies", lines, kept);
+        for (int i = 0; i < kept; i++) {
+            set_active_finding_file(index->filenames[locations[i].file_id], NULL, 0);
+            record_finding(locations[i].line_start, CHECK_CLONE, message);
+        }
+    }
+    return 1;
+}
+
+// Function to turn fingerprints shared between locations into clone classes, one per copied block
+// Every location of a fingerprint is paired with its first location only, so a block copied into
+// n files costs n - 1 pairs, and the merged clones that share a first location form one class
+void report_clones(CloneIndex *index, FILE *output_file) {
+    ClonePair *pairs = NULL;
+    CloneLocation *locations = NULL;
+    size_t pair_count = 0, pair_capacity = 0, clone_count = 0, merged_count = 0, boilerplate_count = 0;
+    uint64_t widest_mask = 0;
+
+    for (int s = 0; s < CLONE_SHARDS; s++) {
+        CloneShard *shard = &index->shards[s];
+        size_t group_start = 0;
+
+        if (shard->sample_mask > widest_mask) widest_mask = shard->sample_mask;
+        if (shard->count > 0) {
+            qsort(shard->entries, shard->count, sizeof(CloneFingerprint), compare_fingerprints);
+        }
+
+        for (size_t i = 1; i <= shard->count; i++) {
+            CloneFingerprint *x = &shard->entries[group_start];
+            if (i < shard->count && shard->entries[i].hash == x->hash) {
+                continue;
+            }
+            for (size_t b = group_start + 1; b < i; b++) {
+                CloneFingerprint *y = &shard->entries[b];
+                if (x->file_id == y->file_id && y->line_start <= x->line_end) {
+                    continue;
+                }
+                if (add_clone_pair(&pairs, &pair_count, &pair_capacity, x, y) != 0) {
+                    fprintf(output_file, "Error: Memory allocation failed.\n");
+                    free(pairs);
+                    return;
+                }
+            }
+            group_start = i;
+        }
+    }
+
+    fprintf(output_file, "Clone detection for %d files:\n", index->file_count);
+    if (widest_mask != 0) {
+        fprintf(output_file, "Warning: Fingerprint index reached its budget, sampled 1 in %llu fingerprints.\n",
+                (unsigned long long)widest_mask + 1);
+    }
+
+    // Merge nearby matches that keep the same line offset between the two files into one clone
+    // Winnowing and sampling leave small gaps inside long clones, so those are bridged
+    if (pair_count > 0) {
+        qsort(pairs, pair_count, sizeof(ClonePair), compare_clone_pairs);
+    }
+    for (size_t i = 0; i < pair_count;) {
+        ClonePair clone = pairs[i++];
+        while (i < pair_count && pairs[i].file_a == clone.file_a && pairs[i].file_b == clone.file_b &&
+               pairs[i].b_start - pairs[i].a_start == clone.b_start - clone.a_start &&
+               pairs[i].a_start <= clone.a_end + CLONE_MERGE_GAP) {
+            if (pairs[i].a_end > clone.a_end) clone.a_end = pairs[i].a_end;
+            if (pairs[i].b_end > clone.b_end) clone.b_end = pairs[i].b_end;
+            i++;
+        }
+        if (clone.a_end - clone.a_start + 1 < CLONE_MIN_LINES) {
+            continue;
+        }
+        // Merging can grow the two ranges of a repetitive block in one file into each other
+        if (clone.file_a == clone.file_b && clone.b_start <= clone.a_end && clone.a_start <= clone.b_end) {
+            continue;
+        }
+        pairs[merged_count++] = clone;
+    }
+
+    // Clones whose first locations cover at least half of each other are copies of the same block;
+    // shorter clones nested in a longer one are copies of a smaller block and get their own class
+    if (merged_count > 0) {
+        qsort(pairs, merged_count, sizeof(ClonePair), compare_clone_anchors);
+        locations = (CloneLocation *)malloc((merged_count + 1) * sizeof(CloneLocation));
+        if (locations == NULL) {
+            fprintf(output_file, "Error: Memory allocation failed.\n");
+            free(pairs);
+            return;
+        }
+    }
+    for (size_t i = 0; i < merged_count; i++) {
+        ClonePair anchor = pairs[i];
+        int anchor_lines = anchor.a_end - anchor.a_start + 1, location_count = 1, reported;
+
+        if (anchor.file_a < 0) {
+            continue; // Already part of a class
+        }
+        locations[0].file_id = anchor.file_a;
+        locations[0].line_start = anchor.a_start;
+        locations[0].line_end = anchor.a_end;
+        for (size_t j = i; j < merged_count; j++) {
+            int overlap;
+            if (pairs[j].file_a < 0) continue;
+            if (pairs[j].file_a != anchor.file_a || pairs[j].a_start > anchor.a_end) break;
+            overlap = (pairs[j].a_end < anchor.a_end ? pairs[j].a_end : anchor.a_end) - pairs[j].a_start + 1;
+            if (2 * overlap < anchor_lines || 2 * overlap < pairs[j].a_end - pairs[j].a_start + 1) {
+                continue;
+            }
+            locations[location_count].file_id = pairs[j].file_b;
+            locations[location_count].line_start = pairs[j].b_start;
+            locations[location_count].line_end = pairs[j].b_end;
+            location_count++;
+            pairs[j].file_a = -1;
+        }
+        reported = report_clone_class(index, locations, location_count, output_file);
+        if (reported > 0) {
+            clone_count++;
+        } else if (reported < 0) {
+            boilerplate_count++;
+        }
+    }
+    fprintf(output_file, "Number of clones: %zu\n", clone_count);
+    if (boilerplate_count > 0) {
+        fprintf(output_file, "Blocks copied more than %d times (boilerplate, not listed): %zu\n", index->max_copies, boilerplate_count);
+    }
+    fprintf(output_file, "\n");
+
+    free(locations);
+    free(pairs);
+}
+
+// Function to name an I/O backend for reports
+const char *io_backend_name(int backend) {
+    switch (backend) {
+        case IO_BACKEND_STDIO: return "stdio";
+        case IO_BACKEND_THREADS: return "threads";
+        case IO_BACKEND_URING: return "io_uring";
+        default: return "auto";
+    }
+}
+
+// Function to publish a loaded file to the analysis
+static void file_loader_complete(FileLoader *loader, int index, char *data, size_t size, int status) {
+    pthread_mutex_lock(&loader->lock);
+    loader->files[index].data = data;
+    loader->files[index].size = size;
+    loader->files[index].status = status;
+    loader->files[index].ready = 1;
+    pthread_cond_broadcast(&loader->changed);
+    pthread_mutex_unlock(&loader->lock);
+}
+
+// Function run by each reader thread of the thread-pool backend
+void *file_loader_thread_worker(void *arg) {
+    FileLoader *loader = (FileLoader *)arg;
+
+    for (;;) {
+        char *data = NULL;
+        size_t size = 0;
+        int index, status = 0;
+
+        pthread_mutex_lock(&loader->lock);
+        for (;;) {
+            // Files an abandoned io_uring ring already finished are not loaded again
+            while (loader->next_to_start < loader->file_count && loader->files[loader->next_to_start].ready) {
+                loader->next_to_start++;
+            }
+            if (loader->next_to_start >= loader->file_count || loader->next_to_start < loader->released + loader->read_ahead) {
+                break;
+            }
+            pthread_cond_wait(&loader->changed, &loader->lock);
+        }
+        if (loader->next_to_start >= loader->file_count) {
+            pthread_mutex_unlock(&loader->lock);
+            break;
+        }
+        index = loader->next_to_start++;
+        pthread_mutex_unlock(&loader->lock);
+
+        // Unsupported files are reported by the analysis without being read
+        if (detect_file_type(loader->filenames[index]) >= 0) {
+            status = read_file_contents(loader->filenames[index], &data, &size);
+        }
+        file_loader_complete(loader, index, data, size, status);
+    }
+    return NULL;
+}
+
+#ifdef HAVE_IO_URING
+#define URING_OP_OPEN 0
+#define URING_OP_STATX 1
+#define URING_OP_READ 2
+#define URING_OP_CLOSE 3
+#define URING_MAX_READ (1U << 30)
+#define URING_DRAIN_MS 1000 // How long an abandoned ring may take to finish the requests it accepted
+
+// Function to release the memory mappings and descriptor of a ring
+static void io_ring_teardown(IoRing *ring) {
+    if (ring->sqes != NULL && ring->sqes != MAP_FAILED) munmap(ring->sqes, ring->sqes_size);
+    if (ring->cq_ring != NULL && ring->cq_ring != MAP_FAILED && ring->cq_ring != ring->sq_ring) munmap(ring->cq_ring, ring->cq_ring_size);
+    if (ring->sq_ring != NULL && ring->sq_ring != MAP_FAILED) munmap(ring->sq_ring, ring->sq_ring_size);
+    if (ring->fd >= 0) close(ring->fd);
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+}
+
+// Function to create a ring and check that the kernel supports every operation the loader needs
+// Returns 0 on success, -1 if io_uring is unavailable (old kernel, disabled, or missing operations)
+static int io_ring_setup(IoRing *ring, unsigned entries) {
+    const int required_ops[] = {IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ, IORING_OP_CLOSE};
+    struct io_uring_params params;
+    struct io_uring_probe *probe;
+    int supported = 1;
+
+    memset(ring, 0, sizeof(*ring));
+    memset(&params, 0, sizeof(params));
+    ring->fd = (int)syscall(__NR_io_uring_setup, entries, &params);
+    if (ring->fd < 0) {
+        ring->fd = -1;
+        return -1;
+    }
+
+    ring->sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    ring->cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_ring_size > ring->sq_ring_size) ring->sq_ring_size = ring->cq_ring_size;
+        ring->cq_ring_size = ring->sq_ring_size;
+    }
+
+    ring->sq_ring = mmap(NULL, ring->sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ring == MAP_FAILED) {
+        io_ring_teardown(ring);
+        return -1;
+    }
+    if (params.features & IORING_FEAT_SINGLE_MMAP) {
+        ring->cq_ring = ring->sq_ring;
+    } else {
+        ring->cq_ring = mmap(NULL, ring->cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ring == MAP_FAILED) {
+            io_ring_teardown(ring);
+            return -1;
+        }
+    }
+    ring->sqes = (struct io_uring_sqe *)mmap(NULL, ring->sqes_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED) {
+        io_ring_teardown(ring);
+        return -1;
+    }
+
+    ring->sq_head = (unsigned *)((char *)ring->sq_ring + params.sq_off.head);
+    ring->sq_tail = (unsigned *)((char *)ring->sq_ring + params.sq_off.tail);
+    ring->sq_mask = (unsigned *)((char *)ring->sq_ring + params.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)((char *)ring->sq_ring + params.sq_off.array);
+    ring->cq_head = (unsigned *)((char *)ring->cq_ring + params.cq_off.head);
+    ring->cq_tail = (unsigned *)((char *)ring->cq_ring + params.cq_off.tail);
+    ring->cq_mask = (unsigned *)((char *)ring->cq_ring + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)((char *)ring->cq_ring + params.cq_off.cqes);
+    ring->sq_entries = params.sq_entries;
+
+    // Opening, stat and close through io_uring need Linux 5.6 or newer
+    probe = (struct io_uring_probe *)calloc(1, sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op));
+    if (probe == NULL || syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_PROBE, probe, 256) < 0) {
+        supported = 0;
+    } else {
+        for (size_t i = 0; i < sizeof(required_ops) / sizeof(required_ops[0]); i++) {
+            if (required_ops[i] > probe->last_op || !(probe->ops[required_ops[i]].flags & IO_URING_OP_SUPPORTED)) {
+                supported = 0;
+            }
+        }
+    }
+    free(probe);
+    if (!supported) {
+        io_ring_teardown(ring);
+        return -1;
+    }
+    return 0;
+}
+
+// Function to submit queued entries and optionally wait for completions
+static int io_ring_enter(IoRing *ring, unsigned min_complete) {
+    int submitted;
+
+    do {
+        submitted = (int)syscall(__NR_io_uring_enter, ring->fd, ring->to_submit, min_complete,
+                                 min_complete ? IORING_ENTER_GETEVENTS : 0, NULL, 0);
+    } while (submitted < 0 && errno == EINTR);
+    if (submitted < 0) {
+        return -1;
+    }
+    ring->to_submit -= (unsigned)submitted;
+    return 0;
+}
+
+// Function to queue one operation on the submission ring, flushing it first if it is full
+static int io_ring_queue(IoRing *ring, int opcode, int fd, const void *addr, unsigned len, uint64_t offset, uint64_t user_data) {
+    unsigned tail = *ring->sq_tail;
+    unsigned index;
+    struct io_uring_sqe *sqe;
+
+    if (tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >= ring->sq_entries) {
+        if (io_ring_enter(ring, 0) != 0 || tail - __atomic_load_n(ring->sq_head, __ATOMIC_ACQUIRE) >= ring->sq_entries) {
+            return -1;
+        }
+    }
+
+    index = tail & *ring->sq_mask;
+    sqe = &ring->sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = (uint8_t)opcode;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)addr;
+    sqe->len = len;
+    sqe->off = offset;
+    sqe->user_data = user_data;
+    if (opcode == IORING_OP_OPENAT) {
+        sqe->open_flags = O_RDONLY | O_CLOEXEC;
+    }
+    ring->sq_array[index] = index;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ring->to_submit++;
+    return 0;
+}
+
+// Function to stop using a ring that failed: wait for the requests the kernel accepted, then tear it down
+// Returns 1 if they all completed, 0 if some may still write into the slots or file buffers
+static int uring_abandon(IoRing *ring, int in_flight) {
+    struct timespec pause = {0, 1000000};
+    int outstanding = in_flight - (int)ring->to_submit; // Entries never submitted did not reach the kernel
+    unsigned head = *ring->cq_head;
+
+    // The kernel posts completions to the shared ring without io_uring_enter
+    for (int waited = 0; outstanding > 0 && waited < URING_DRAIN_MS;) {
+        unsigned tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+        if (head == tail) {
+            nanosleep(&pause, NULL);
+            waited++;
+            continue;
+        }
+        for (; head != tail; head++) {
+            struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+            if ((int)(cqe->user_data & 3) == URING_OP_OPEN && cqe->res >= 0) {
+                close(cqe->res);
+            }
+            outstanding--;
+        }
+    }
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    io_ring_teardown(ring);
+    return outstanding <= 0;
+}
+
+// Function to start reading a file once both its open and statx have completed
+static int uring_start_read(FileLoader *loader, IoRingSlot *slot, int index) {
+    char *data;
+    size_t size;
+
+    if (slot->open_result < 0) {
+        file_loader_complete(loader, index, NULL, 0, -1);
+        return 0;
+    }
+    if (slot->stat_result < 0) {
+        file_loader_complete(loader, index, NULL, 0, -1);
+        return io_ring_queue(&loader->ring, IORING_OP_CLOSE, slot->fd, NULL, 0, 0, ((uint64_t)index << 2) | URING_OP_CLOSE) == 0 ? 1 : 0;
+    }
+
+    size = (size_t)slot->stat.stx_size;
+    data = (char *)malloc(size + 1);
+    if (data == NULL || size == 0) {
+        file_loader_complete(loader, index, data, 0, data == NULL ? -2 : 0);
+        return io_ring_queue(&loader->ring, IORING_OP_CLOSE, slot->fd, NULL, 0, 0, ((uint64_t)index << 2) | URING_OP_CLOSE) == 0 ? 1 : 0;
+    }
+    loader->files[index].data = data;
+    loader->files[index].size = size;
+    slot->offset = 0;
+    if (io_ring_queue(&loader->ring, IORING_OP_READ, slot->fd, data, size < URING_MAX_READ ? (unsigned)size : URING_MAX_READ, 0,
+                      ((uint64_t)index << 2) | URING_OP_READ) != 0) {
+        close(slot->fd);
+        file_loader_complete(loader, index, NULL, 0, -1);
+        free(data);
+        return 0;
+    }
+    return 1;
+}
+
+// Function run by the io_uring loader thread
+// Each file goes through openat and statx (issued together), then read, then close,
+// with up to read_ahead files in flight so the analysis never waits on a single syscall
+void *file_loader_uring_worker(void *arg) {
+    FileLoader *loader = (FileLoader *)arg;
+    IoRing *ring = &loader->ring;
+    IoRingSlot *slots;
+    int in_flight = 0;
+
+    slots = (IoRingSlot *)calloc(loader->read_ahead, sizeof(IoRingSlot));
+    if (slots == NULL) {
+        return file_loader_thread_worker(loader);
+    }
+
+    for (;;) {
+        int start, limit;
+        unsigned head, tail;
+
+        // Start every file the read-ahead window allows
+        pthread_mutex_lock(&loader->lock);
+        while (in_flight == 0 && loader->next_to_start < loader->file_count &&
+               loader->next_to_start >= loader->released + loader->read_ahead) {
+            pthread_cond_wait(&loader->changed, &loader->lock);
+        }
+        start = loader->next_to_start;
+        limit = loader->released + loader->read_ahead;
+        if (limit > loader->file_count) limit = loader->file_count;
+        if (limit > start) loader->next_to_start = limit;
+        pthread_mutex_unlock(&loader->lock);
+
+        for (int i = start; i < limit; i++) {
+            IoRingSlot *slot = &slots[i % loader->read_ahead];
+            const char *path = loader->filenames[i];
+
+            if (detect_file_type(path) < 0) {
+                file_loader_complete(loader, i, NULL, 0, 0);
+                continue;
+            }
+            memset(slot, 0, sizeof(*slot));
+            slot->fd = -1;
+            slot->pending = 2;
+            if (io_ring_queue(ring, IORING_OP_OPENAT, AT_FDCWD, path, 0, 0, ((uint64_t)i << 2) | URING_OP_OPEN) != 0) {
+                file_loader_complete(loader, i, NULL, 0, -1);
+                continue;
+            }
+            in_flight++;
+            if (io_ring_queue(ring, IORING_OP_STATX, AT_FDCWD, path, STATX_SIZE, (uint64_t)(uintptr_t)&slot->stat,
+                              ((uint64_t)i << 2) | URING_OP_STATX) != 0) {
+                slot->pending = 1;
+                slot->stat_result = -1;
+                continue;
+            }
+            in_flight++;
+        }
+
+        if (in_flight == 0) {
+            if (start >= loader->file_count) break;
+            continue;
+        }
+
+        if (io_ring_enter(ring, 1) != 0 && errno != EBUSY && errno != EAGAIN) {
+            // The ring is unusable: stop it and hand every file it had not finished back to a reader thread
+            // Memory the kernel may still write into is leaked rather than freed
+            int drained = uring_abandon(ring, in_flight);
+            int first_unready = -1;
+
+            pthread_mutex_lock(&loader->lock);
+            for (int i = 0; i < loader->next_to_start; i++) {
+                LoadedFile *file = &loader->files[i];
+                if (file->ready) {
+                    continue;
+                }
+                if (first_unready < 0) first_unready = i;
+                if (slots[i % loader->read_ahead].fd >= 0) close(slots[i % loader->read_ahead].fd);
+                if (drained) free(file->data);
+                file->data = NULL;
+                file->size = 0;
+            }
+            if (first_unready >= 0) loader->next_to_start = first_unready;
+            pthread_mutex_unlock(&loader->lock);
+            if (drained) free(slots);
+            return file_loader_thread_worker(loader);
+        }
+
+        // Reap completions and queue the next step of each file
+        head = *ring->cq_head;
+        tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+        while (head != tail) {
+            struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+            int index = (int)(cqe->user_data >> 2);
+            int op = (int)(cqe->user_data & 3);
+            int result = cqe->res;
+            IoRingSlot *slot = &slots[index % loader->read_ahead];
+            head++;
+            in_flight--;
+
+            if (op == URING_OP_CLOSE) {
+                continue;
+            }
+            if (op == URING_OP_OPEN || op == URING_OP_STATX) {
+                if (op == URING_OP_OPEN) {
+                    slot->open_result = result;
+                    if (result >= 0) slot->fd = result;
+                } else {
+                    slot->stat_result = result;
+                }
+                if (--slot->pending == 0) {
+                    in_flight += uring_start_read(loader, slot, index);
+                }
+                continue;
+            }
+
+            // Read completion: keep reading after a short read, then close and hand the file over
+            {
+                LoadedFile *file = &loader->files[index];
+                if (result < 0) {
+                    free(file->data);
+                    file_loader_complete(loader, index, NULL, 0, -1);
+                } else if (result > 0 && slot->offset + (size_t)result < file->size) {
+                    size_t remaining;
+                    slot->offset += (size_t)result;
+                    remaining = file->size - slot->offset;
+                    if (io_ring_queue(ring, IORING_OP_READ, slot->fd, file->data + slot->offset,
+                                      remaining < URING_MAX_READ ? (unsigned)remaining : URING_MAX_READ,
+                                      slot->offset, ((uint64_t)index << 2) | URING_OP_READ) == 0) {
+                        in_flight++;
+                        continue;
+                    }
+                    free(file->data);
+                    file_loader_complete(loader, index, NULL, 0, -1);
+                } else {
+                    file_loader_complete(loader, index, file->data, slot->offset + (size_t)result, 0);
+                }
+                if (io_ring_queue(ring, IORING_OP_CLOSE, slot->fd, NULL, 0, 0, ((uint64_t)index << 2) | URING_OP_CLOSE) == 0) {
+                    in_flight++;
+                } else {
+                    close(slot->fd);
+                }
+            }
+        }
+        __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+    }
+
+    free(slots);
+    return NULL;
+}
+#endif
+
+// Function to start loading the input files in the background with the requested backend
+// Returns 0 on success, -2 if memory allocation failed
+int file_loader_start(FileLoader *loader, char *filenames[], int file_count, int backend, int read_ahead, int thread_count) {
+    memset(loader, 0, sizeof(*loader));
+    loader->filenames = filenames;
+    loader->file_count = file_count;
+    loader->read_ahead = read_ahead > 0 ? read_ahead : DEFAULT_READ_AHEAD;
+    loader->files = (LoadedFile *)calloc(file_count, sizeof(LoadedFile));
+    if (loader->files == NULL) {
+        return -2;
+    }
+    pthread_mutex_init(&loader->lock, NULL);
+    pthread_cond_init(&loader->changed, NULL);
+
+#ifdef HAVE_IO_URING
+    loader->ring.fd = -1;
+    if (backend == IO_BACKEND_AUTO || backend == IO_BACKEND_URING) {
+        if (io_ring_setup(&loader->ring, (unsigned)loader->read_ahead * 2) == 0) {
+            backend = IO_BACKEND_URING;
+        } else {
+            backend = IO_BACKEND_THREADS;
+        }
+    }
+#else
+    if (backend == IO_BACKEND_AUTO || backend == IO_BACKEND_URING) {
+        backend = IO_BACKEND_THREADS;
+    }
+#endif
+    loader->backend = backend;
+
+    if (backend == IO_BACKEND_STDIO) {
+        return 0;
+    }
+
+    loader->thread_count = backend == IO_BACKEND_URING ? 1 : thread_count;
+    loader->threads = (pthread_t *)malloc(loader->thread_count * sizeof(pthread_t));
+    if (loader->threads == NULL) {
+        loader->thread_count = 0;
+        loader->backend = IO_BACKEND_STDIO;
+        return 0;
+    }
+    for (int i = 0; i < loader->thread_count; i++) {
+#ifdef HAVE_IO_URING
+        void *(*worker)(void *) = backend == IO_BACKEND_URING ? file_loader_uring_worker : file_loader_thread_worker;
+#else
+        void *(*worker)(void *) = file_loader_thread_worker;
+#endif
+        if (pthread_create(&loader->threads[i], NULL, worker, loader) != 0) {
+            loader->thread_count = i;
+            break;
+        }
+    }
+    // Load on the calling thread if no reader could be started
+    if (loader->thread_count == 0) {
+        loader->backend = IO_BACKEND_STDIO;
+    }
+    return 0;
+}
+
+// Function to wait until a file has been loaded
+LoadedFile *file_loader_wait(FileLoader *loader, int index) {
+    LoadedFile *file = &loader->files[index];
+
+    if (loader->backend == IO_BACKEND_STDIO) {
+        if (detect_file_type(loader->filenames[index]) >= 0) {
+            file->status = read_file_contents(loader->filenames[index], &file->data, &file->size);
+        }
+        file->ready = 1;
+        return file;
+    }
+
+    pthread_mutex_lock(&loader->lock);
+    while (!file->ready) {
+        pthread_cond_wait(&loader->changed, &loader->lock);
+    }
+    pthread_mutex_unlock(&loader->lock);
+    return file;
+}
+
+// Function to free a file once it has been analyzed and let the loaders move ahead
+void file_loader_release(FileLoader *loader, int index) {
+    pthread_mutex_lock(&loader->lock);
+    free(loader->files[index].data);
+    loader->files[index].data = NULL;
+    loader->released = index + 1;
+    pthread_cond_broadcast(&loader->changed);
+    pthread_mutex_unlock(&loader->lock);
+}
+
+// Function to wait for the loaders to stop and free their resources
+void file_loader_finish(FileLoader *loader) {
+    for (int i = 0; i < loader->thread_count; i++) {
+        pthread_join(loader->threads[i], NULL);
+    }
+#ifdef HAVE_IO_URING
+    if (loader->ring.fd >= 0) {
+        io_ring_teardown(&loader->ring);
+    }
+#endif
+    for (int i = 0; i < loader->file_count; i++) {
+        free(loader->files[i].data);
+    }
+    pthread_cond_destroy(&loader->changed);
+    pthread_mutex_destroy(&loader->lock);
+    free(loader->threads);
+    free(loader->files);
+}
+
+// Function to load every file without analyzing it and report the loading throughput
+void run_io_benchmark(FileLoader *loader) {
+    struct timespec started, finished;
+    size_t total_bytes = 0;
+    int failed = 0;
+    double seconds;
+
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    for (int i = 0; i < loader->file_count; i++) {
+        LoadedFile *file = file_loader_wait(loader, i);
+        if (file->status != 0) {
+            failed++;
+        }
+        total_bytes += file->size;
+        file_loader_release(loader, i);
+    }
+    clock_gettime(CLOCK_MONOTONIC, &finished);
+
+    seconds = (finished.tv_sec - started.tv_sec) + (finished.tv_nsec - started.tv_nsec) / 1e9;
+    printf("Backend: %s (read-ahead %d)\n", io_backend_name(loader->backend), loader->read_ahead);
+    printf("Loaded %d files (%zu bytes, %d failed) in %.3f s\n", loader->file_count, total_bytes, failed, seconds);
+    printf("Throughput: %.0f files/sec, %.1f MB/sec\n",
+           seconds > 0 ? loader->file_count / seconds : 0.0, seconds > 0 ? total_bytes / seconds / 1e6 : 0.0);
+}
+
+#ifdef HAVE_INOTIFY
+// Function to check if a file name ends with a supported source extension
+static int has_source_extension(const char *name) {
+    size_t length = strlen(name);
+    return (length > 2 && strcmp(name + length - 2, ".c") == 0) ||
+           (length > 4 && strcmp(name + length - 4, ".cpp") == 0);
+}
+
+// Function to join a directory and a name into a newly allocated path
+static char *join_path(const char *directory, const char *name) {
+    size_t directory_length = strlen(directory);
+    int needs_separator = directory_length > 0 && directory[directory_length - 1] != '/';
+    char *path = (char *)malloc(directory_length + needs_separator + strlen(name) + 1);
+
+    if (path != NULL) {
+        strcpy(path, directory);
+        if (needs_separator) strcat(path, "/");
+        strcat(path, name);
+    }
+    return path;
+}
+
+// Function to order watched files by path
+static int compare_watched_files(const void *left, const void *right) {
+    return strcmp(((const WatchedFile *)left)->path, ((const WatchedFile *)right)->path);
+}
+
+// Function to stop tracking a file, or every file under a directory when prefix is set
+static void watch_remove_files(WatchState *state, const char *path, int prefix) {
+    size_t path_length = strlen(path);
+    int kept = 0;
+
+    for (int i = 0; i < state->file_count; i++) {
+        WatchedFile *file = &state->files[i];
+        int matches = prefix ? strncmp(file->path, path, path_length) == 0 && file->path[path_length] == '/'
+                             : strcmp(file->path, path) == 0;
+        if (matches) {
+            free(file->path);
+            free(file->report);
+        } else {
+            state->files[kept++] = *file;
+        }
+    }
+    state->file_count = kept;
+
+    // Directories moved out of the tree are no longer watched
+    if (prefix) {
+        kept = 0;
+        for (int i = 0; i < state->directory_count; i++) {
+            WatchedDirectory *directory = &state->directories[i];
+            if (strcmp(directory->path, path) == 0 ||
+                (strncmp(directory->path, path, path_length) == 0 && directory->path[path_length] == '/')) {
+                inotify_rm_watch(state->inotify_fd, directory->wd);
+                free(directory->path);
+            } else {
+                state->directories[kept++] = *directory;
+            }
+        }
+        state->directory_count = kept;
+    }
+}
+
+// Function to release everything watch mode holds
+static void watch_free(WatchState *state) {
+    for (int i = 0; i < state->file_count; i++) {
+        free(state->files[i].path);
+        free(state->files[i].report);
+    }
+    for (int i = 0; i < state->directory_count; i++) {
+        free(state->directories[i].path);
+    }
+    free(state->files);
+    free(state->directories);
+    if (state->inotify_fd >= 0) {
+        close(state->inotify_fd);
+    }
+}
+
+// Function to return the milliseconds elapsed since a point in time
+static double elapsed_ms(const struct timespec *since) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - since->tv_sec) * 1e3 + (now.tv_nsec - since->tv_nsec) / 1e6;
+}
+
+// Function to append a file found while scanning; the caller sorts the files afterwards
+static int watch_append_file(WatchState *state, const char *path) {
+    if (state->file_count >= state->file_capacity) {
+        int new_capacity = state->file_capacity ? state->file_capacity * 2 : 256;
+        WatchedFile *resized = (WatchedFile *)realloc(state->files, new_capacity * sizeof(WatchedFile));
+        if (resized == NULL) {
+            return -2;
+        }
+        state->files = resized;
+        state->file_capacity = new_capacity;
+    }
+    memset(&state->files[state->file_count], 0, sizeof(WatchedFile));
+    state->files[state->file_count].path = strdup(path);
+    if (state->files[state->file_count].path == NULL) {
+        return -2;
+    }
+    state->files[state->file_count].dirty = 1;
+    state->file_count++;
+    return 0;
+}
+
+// Function to sort the watched files and merge files that were found more than once
+static void watch_sort_files(WatchState *state) {
+    int kept = 0;
+
+    if (state->file_count == 0) {
+        return;
+    }
+    qsort(state->files, state->file_count, sizeof(WatchedFile), compare_watched_files);
+    for (int i = 1; i < state->file_count; i++) {
+        WatchedFile *last = &state->files[kept];
+        if (strcmp(state->files[i].path, last->path) == 0) {
+            if (last->report == NULL) {
+                last->report = state->files[i].report;
+                last->report_size = state->files[i].report_size;
+            } else {
+                free(state->files[i].report);
+            }
+            free(state->files[i].path);
+            last->dirty = 1;
+        } else {
+            state->files[++kept] = state->files[i];
+        }
+    }
+    state->file_count = kept + 1;
+}
+
+// Function to find a watched file by path
+WatchedFile *watch_find_file(WatchState *state, const char *path) {
+    WatchedFile key;
+    key.path = (char *)path;
+    if (state->file_count == 0) {
+        return NULL;
+    }
+    return (WatchedFile *)bsearch(&key, state->files, state->file_count, sizeof(WatchedFile), compare_watched_files);
+}
+
+// Function to start tracking a file (or mark a tracked one as changed)
+// Returns 0 on success, -2 if memory allocation failed
+int watch_track_file(WatchState *state, const char *path) {
+    WatchedFile *file = watch_find_file(state, path);
+    WatchedFile added;
+    int low = 0, high;
+
+    if (file != NULL) {
+        file->dirty = 1;
+        return 0;
+    }
+    if (watch_append_file(state, path) != 0) {
+        return -2;
+    }
+
+    // Move the new file to its sorted position so lookups can use bsearch and the report order is stable
+    added = state->files[state->file_count - 1];
+    high = state->file_count - 1;
+    while (low < high) {
+        int middle = low + (high - low) / 2;
+        if (strcmp(state->files[middle].path, path) < 0) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    memmove(&state->files[low + 1], &state->files[low], (state->file_count - 1 - low) * sizeof(WatchedFile));
+    state->files[low] = added;
+    return 0;
+}
+
+// Function to watch one directory and scan it, recursing into subdirectories
+static int watch_scan_directory(WatchState *state, const char *path) {
+    const uint32_t events = IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE;
+    struct dirent *entry;
+    DIR *directory;
+    int wd, known = 0;
+
+    wd = inotify_add_watch(state->inotify_fd, path, events | IN_ONLYDIR);
+    if (wd < 0) {
+        return -1;
+    }
+
+    for (int i = 0; i < state->directory_count; i++) {
+        if (state->directories[i].wd == wd) {
+            known = 1;
+            // A directory moved within the tree keeps its watch under a new path
+            if (strcmp(state->directories[i].path, path) != 0) {
+                char *moved = strdup(path);
+                if (moved == NULL) {
+                    return -2;
+                }
+                free(state->directories[i].path);
+                state->directories[i].path = moved;
+            }
+            break;
+        }
+    }
+    if (!known) {
+        if (state->directory_count >= state->directory_capacity) {
+            int new_capacity = state->directory_capacity ? state->directory_capacity * 2 : 64;
+            WatchedDirectory *resized = (WatchedDirectory *)realloc(state->directories, new_capacity * sizeof(WatchedDirectory));
+            if (resized == NULL) {
+                return -2;
+            }
+            state->directories = resized;
+            state->directory_capacity = new_capacity;
+        }
+        state->directories[state->directory_count].wd = wd;
+        state->directories[state->directory_count].path = strdup(path);
+        if (state->directories[state->directory_count].path == NULL) {
+            return -2;
+        }
+        state->directory_count++;
+    }
+
+    directory = opendir(path);
+    if (directory == NULL) {
+        return -1;
+    }
+    while ((entry = readdir(directory)) != NULL) {
+        struct stat info;
+        char *child;
+        int is_directory, is_file;
+
+        if (entry->d_name[0] == '.') {
+            continue;
+        }
+        child = join_path(path, entry->d_name);
+        if (child == NULL) {
+            closedir(directory);
+            return -2;
+        }
+
+        is_directory = entry->d_type == DT_DIR;
+        is_file = entry->d_type == DT_REG;
+        if (entry->d_type == DT_UNKNOWN && lstat(child, &info) == 0) {
+            is_directory = S_ISDIR(info.st_mode);
+            is_file = S_ISREG(info.st_mode);
+        }
+
+        if (is_directory) {
+            // A subdirectory that disappears while scanning is simply not watched
+            if (watch_scan_directory(state, child) == -2) {
+                free(child);
+                closedir(directory);
+                return -2;
+            }
+        } else if (is_file && has_source_extension(entry->d_name)) {
+            if (watch_append_file(state, child) != 0) {
+                free(child);
+                closedir(directory);
+                return -2;
+            }
+        }
+        free(child);
+    }
+    closedir(directory);
+    return 0;
+}
+
+// Function to watch a directory and everything below it, tracking the source files it contains
+// Hidden entries (such as .git) and symbolic links are skipped
+// Returns 0 on success, -1 if the directory could not be watched or read, -2 if memory allocation failed
+int watch_add_directory(WatchState *state, const char *path) {
+    int status = watch_scan_directory(state, path);
+    watch_sort_files(state);
+    return status;
+}
+
+// Function to check if a path is below a directory
+static int is_below_directory(const char *path, const char *directory) {
+    size_t length = strlen(directory);
+    if (strncmp(path, directory, length) != 0) {
+        return 0;
+    }
+    return length > 0 && directory[length - 1] == '/' ? path[length] != '\0' : path[length] == '/';
+}
+
+// Function to order paths from shortest to longest, so a directory comes before everything below it
+static int compare_path_lengths(const void *left, const void *right) {
+    size_t left_length = strlen(*(char *const *)left), right_length = strlen(*(char *const *)right);
+    return (left_length > right_length) - (left_length < right_length);
+}
+
+// Function to rebuild the watched files and directories from a fresh scan of the top-level directories
+// Used when inotify dropped events, so files and directories deleted meanwhile are dropped too
+// Returns 0 on success, -2 if memory allocation failed
+static int watch_rescan(WatchState *state) {
+    WatchedDirectory *old_directories = state->directories;
+    int old_directory_count = state->directory_count, root_count = 0, status = 0, kept = 0;
+    char **roots = (char **)malloc((old_directory_count + 1) * sizeof(char *));
+
+    if (roots == NULL) {
+        return -2;
+    }
+    // Scanning a top-level directory recurses, so directories below another watched one are not scanned again
+    for (int i = 0; i < old_directory_count; i++) {
+        roots[i] = old_directories[i].path;
+    }
+    qsort(roots, old_directory_count, sizeof(char *), compare_path_lengths);
+    for (int i = 0; i < old_directory_count; i++) {
+        int nested = 0;
+        for (int j = 0; j < root_count && !nested; j++) {
+            nested = is_below_directory(roots[i], roots[j]);
+        }
+        if (!nested) {
+            roots[root_count++] = roots[i];
+        }
+    }
+
+    // Files the rescan finds are merged with their entries and marked dirty; the others are left unmarked
+    for (int i = 0; i < state->file_count; i++) {
+        state->files[i].dirty = 0;
+    }
+    state->directories = NULL;
+    state->directory_count = 0;
+    state->directory_capacity = 0;
+    for (int i = 0; i < root_count && status != -2; i++) {
+        status = watch_scan_directory(state, roots[i]);
+    }
+    watch_sort_files(state);
+    for (int i = 0; i < state->file_count; i++) {
+        if (state->files[i].dirty || status == -2) {
+            state->files[kept++] = state->files[i];
+        } else {
+            free(state->files[i].path);
+            free(state->files[i].report);
+        }
+    }
+    state->file_count = kept;
+
+    // Directories the rescan did not reach are gone, so their watches are removed
+    for (int i = 0; i < old_directory_count; i++) {
+        int found = 0;
+        for (int j = 0; j < state->directory_count && !found; j++) {
+            found = state->directories[j].wd == old_directories[i].wd;
+        }
+        if (!found) {
+            inotify_rm_watch(state->inotify_fd, old_directories[i].wd);
+        }
+        free(old_directories[i].path);
+    }
+    free(old_directories);
+    free(roots);
+    return status == -2 ? -2 : 0;
+}
+
+// Function to drain pending inotify events into the watch state
+// Returns the number of events that affect the report, or -1 on error
+int watch_handle_events(WatchState *state) {
+    _Alignas(struct inotify_event) char buffer[64 * 1024];
+    int changes = 0;
+
+    for (;;) {
+        ssize_t length = read(state->inotify_fd, buffer, sizeof(buffer));
+        if (length < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) break;
+            if (errno == EINTR) continue;
+            return -1;
+        }
+        if (length == 0) {
+            break;
+        }
+
+        for (char *position = buffer; position < buffer + length;) {
+            struct inotify_event *event = (struct inotify_event *)position;
+            WatchedDirectory *directory = NULL;
+            char *path;
+
+            position += sizeof(struct inotify_event) + event->len;
+
+            // Events were lost: rebuild the tree from a rescan and re-analyze every file
+            if (event->mask & IN_Q_OVERFLOW) {
+                if (watch_rescan(state) != 0) return -1;
+                changes++;
+                continue;
+            }
+
+            for (int i = 0; i < state->directory_count; i++) {
+                if (state->directories[i].wd == event->wd) {
+                    directory = &state->directories[i];
+                    break;
+                }
+            }
+            if (directory == NULL) {
+                continue;
+            }
+
+            // The directory itself is gone
+            if (event->mask & IN_IGNORED) {
+                free(directory->path);
+                *directory = state->directories[--state->directory_count];
+                continue;
+            }
+            if (event->len == 0 || event->name[0] == '.') {
+                continue;
+            }
+
+            path = join_path(directory->path, event->name);
+            if (path == NULL) {
+                return -1;
+            }
+            if (event->mask & IN_ISDIR) {
+                if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                    if (watch_add_directory(state, path) == -2) {
+                        free(path);
+                        return -1;
+                    }
+                    changes++;
+                } else if (event->mask & IN_MOVED_FROM) {
+                    watch_remove_files(state, path, 1);
+                    changes++;
+                }
+            } else if (has_source_extension(event->name)) {
+                // Saves show up as a close after writing, or as a rename for editors that write a copy first
+                if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+                    if (watch_track_file(state, path) != 0) {
+                        free(path);
+                        return -1;
+                    }
+                    changes++;
+                } else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                    watch_remove_files(state, path, 0);
+                    changes++;
+                }
+            }
+            free(path);
+        }
+    }
+    return changes;
+}
+
+// Function to re-analyze every changed file, keeping each report in memory
+// Returns the number of files analyzed, or -2 if memory allocation failed
+int watch_refresh(WatchState *state, int backend, int read_ahead, int thread_count) {
+    FileLoader loader;
+    char **paths;
+    int *targets;
+    int dirty_count = 0;
+
+    paths = (char **)malloc((state->file_count + 1) * sizeof(char *));
+    targets = (int *)malloc((state->file_count + 1) * sizeof(int));
+    if (paths == NULL || targets == NULL) {
+        free(paths);
+        free(targets);
+        return -2;
+    }
+    for (int i = 0; i < state->file_count; i++) {
+        if (state->files[i].dirty) {
+            paths[dirty_count] = state->files[i].path;
+            targets[dirty_count] = i;
+            dirty_count++;
+        }
+    }
+    if (dirty_count == 0 || file_loader_start(&loader, paths, dirty_count, backend, read_ahead, thread_count) != 0) {
+        free(paths);
+        free(targets);
+        return dirty_count == 0 ? 0 : -2;
+    }
+
+    for (int i = 0; i < dirty_count; i++) {
+        WatchedFile *file = &state->files[targets[i]];
+        char *report = NULL;
+        size_t report_size = 0;
+        FILE *stream = open_memstream(&report, &report_size);
+
+        if (stream != NULL) {
+            analyze_loaded_file(file->path, file_loader_wait(&loader, i), stream, NULL, NULL);
+            fclose(stream);
+            free(file->report);
+            file->report = report;
+            file->report_size = report_size;
+            file->dirty = 0;
+        }
+        file_loader_release(&loader, i);
+    }
+    file_loader_finish(&loader);
+
+    free(paths);
+    free(targets);
+    return dirty_count;
+}
+
+// Function to write the aggregate report from the in-memory results
+// The report is written to a temporary file and renamed, so readers never see a partial report
+// Returns 0 on success, -1 if the output file could not be written
+int watch_write_report(WatchState *state, const char *output_filename) {
+    char temporary_filename[4096];
+    FILE *output_file;
+    int failed = 0;
+
+    snprintf(temporary_filename, sizeof(temporary_filename), "%s.tmp", output_filename);
+    output_file = fopen(temporary_filename, "w");
+    if (output_file == NULL) {
+        return -1;
+    }
+    for (int i = 0; i < state->file_count; i++) {
+        if (state->files[i].report_size > 0 &&
+            fwrite(state->files[i].report, 1, state->files[i].report_size, output_file) != state->files[i].report_size) {
+            failed = 1;
+        }
+    }
+    if (fclose(output_file) != 0 || failed) {
+        remove(temporary_filename);
+        return -1;
+    }
+    return rename(temporary_filename, output_filename) == 0 ? 0 : -1;
+}
+#endif
+
+// Function to run the analysis on every .c/.cpp file under the given directories and keep
+// the report up to date as files are saved, created or deleted
+// Returns 0 when the watch ends normally, 1 on error
+int run_watch_mode(char *directories[], int directory_count, int backend, int read_ahead, int thread_count, int debounce_ms) {
+#ifndef HAVE_INOTIFY
+    (void)directories;
+    (void)directory_count;
+    (void)backend;
+    (void)read_ahead;
+    (void)thread_count;
+    (void)debounce_ms;
+    printf("Error: Watch mode needs inotify, which is only available on Linux.\n");
+    return 1;
+#else
+    WatchState state;
+    struct timespec started, first_pending;
+    int pending = 0, analyzed, result = 0;
+
+    memset(&state, 0, sizeof(state));
+    state.inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (state.inotify_fd < 0) {
+        printf("Error: Could not start watching for file changes.\n");
+        return 1;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &started);
+    for (int i = 0; i < directory_count; i++) {
+        if (watch_add_directory(&state, directories[i]) != 0) {
+            printf("Error: Could not watch directory %s.\n", directories[i]);
+            watch_free(&state);
+            return 1;
+        }
+    }
+
+    // Initial full analysis
+    analyzed = watch_refresh(&state, backend, read_ahead, thread_count);
+    if (analyzed < 0 || watch_write_report(&state, "output.txt") != 0) {
+        printf("Error: Could not write output file.\n");
+        watch_free(&state);
+        return 1;
+    }
+    printf("Analyzed %d files in %.1f ms. Watching for changes, press Ctrl+C to stop.\n", analyzed, elapsed_ms(&started));
+    fflush(stdout);
+
+    for (;;) {
+        struct pollfd poll_fd;
+        int timeout = -1, ready;
+        double waited = 0.0;
+
+        // Wait for the editor to go quiet, but do not let a steady stream of events delay the report forever
+        if (pending) {
+            waited = elapsed_ms(&first_pending);
+            timeout = debounce_ms;
+            if (waited + timeout > WATCH_MAX_DELAY_MS) {
+                timeout = waited >= WATCH_MAX_DELAY_MS ? 0 : (int)(WATCH_MAX_DELAY_MS - waited);
+            }
+        }
+
+        poll_fd.fd = state.inotify_fd;
+        poll_fd.events = POLLIN;
+        poll_fd.revents = 0;
+        ready = poll(&poll_fd, 1, timeout);
+        if (ready < 0) {
+            if (errno == EINTR) continue;
+            result = 1;
+            break;
+        }
+
+        if (ready > 0) {
+            int changes = watch_handle_events(&state);
+            if (changes < 0) {
+                result = 1;
+                break;
+            }
+            if (changes > 0 && !pending) {
+                pending = 1;
+                clock_gettime(CLOCK_MONOTONIC, &first_pending);
+            }
+            if (!pending || elapsed_ms(&first_pending) < WATCH_MAX_DELAY_MS) {
+                continue;
+            }
+        }
+
+        if (pending) {
+            clock_gettime(CLOCK_MONOTONIC, &started);
+            analyzed = watch_refresh(&state, backend, read_ahead, thread_count);
+            if (analyzed < 0 || watch_write_report(&state, "output.txt") != 0) {
+                printf("Error: Could not write output file.\n");
+                result = 1;
+                break;
+            }
+            printf("Re-analyzed %d changed file(s) in %.1f ms, %d files in report.\n", analyzed, elapsed_ms(&started), state.file_count);
+            fflush(stdout);
+            pending = 0;
+        }
+    }
+
+    watch_free(&state);
+    return result;
+#endif
+}
+
+// Function to create an empty string table
+// Returns 0 on success, -2 if memory allocation failed
+int string_table_init(StringTable *table) {
+    memset(table, 0, sizeof(*table));
+    table->arena_capacity = 4096;
+    table->capacity = 64;
+    table->slot_count = 128;
+    table->arena = (char *)malloc(table->arena_capacity);
+    table->offsets = (size_t *)malloc(table->capacity * sizeof(size_t));
+    table->lengths = (uint32_t *)malloc(table->capacity * sizeof(uint32_t));
+    table->hashes = (uint32_t *)malloc(table->capacity * sizeof(uint32_t));
+    table->slots = (int *)malloc(table->slot_count * sizeof(int));
+    if (table->arena == NULL || table->offsets == NULL || table->lengths == NULL || table->hashes == NULL || table->slots == NULL) {
+        string_table_free(table);
+        return -2;
+    }
+    for (size_t i = 0; i < table->slot_count; i++) {
+        table->slots[i] = -1;
+    }
+    return 0;
+}
+
+// Function to locate the hash table slot holding a string, or the empty slot where it belongs
+static size_t string_table_slot(const StringTable *table, const char *text, size_t length, uint32_t hash) {
+    size_t mask = table->slot_count - 1;
+    size_t slot = hash & mask;
+
+    while (table->slots[slot] != -1) {
+        int id = table->slots[slot];
+        if (table->hashes[id] == hash && table->lengths[id] == length &&
+            memcmp(table->arena + table->offsets[id], text, length) == 0) {
+            break;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+// Function to find the id of a string without adding it
+// Returns the id, or -1 if the string is not in the table
+int string_table_find(const StringTable *table, const char *text, size_t length) {
+    uint32_t hash = (uint32_t)hash_token_text(text, (int)length);
+    return table->slots[string_table_slot(table, text, length, hash)];
+}
+
+// Function to get the id of a string, adding it to the table if it is new
+// Returns the id, or -2 if memory allocation failed
+int string_table_intern(StringTable *table, const char *text, size_t length) {
+    uint32_t hash = (uint32_t)hash_token_text(text, (int)length);
+    size_t slot = string_table_slot(table, text, length, hash);
+    int id;
+
+    if (table->slots[slot] != -1) {
+        return table->slots[slot];
+    }
+
+    // Keep the table at most half full so probe sequences stay short
+    if ((size_t)(table->count + 1) * 2 > table->slot_count) {
+        size_t new_slot_count = table->slot_count * 2;
+        int *new_slots = (int *)malloc(new_slot_count * sizeof(int));
+        if (new_slots == NULL) {
+            return -2;
+        }
+        for (size_t i = 0; i < new_slot_count; i++) {
+            new_slots[i] = -1;
+        }
+        for (int i = 0; i < table->count; i++) {
+            size_t position = table->hashes[i] & (new_slot_count - 1);
+            while (new_slots[position] != -1) {
+                position = (position + 1) & (new_slot_count - 1);
+            }
+            new_slots[position] = i;
+        }
+        free(table->slots);
+        table->slots = new_slots;
+        table->slot_count = new_slot_count;
+        slot = string_table_slot(table, text, length, hash);
+    }
+
+    if (table->count >= table->capacity) {
+        int new_capacity = table->capacity * 2;
+        size_t *offsets = (size_t *)realloc(table->offsets, new_capacity * sizeof(size_t));
+        uint32_t *lengths, *hashes;
+        if (offsets == NULL) return -2;
+        table->offsets = offsets;
+        lengths = (uint32_t *)realloc(table->lengths, new_capacity * sizeof(uint32_t));
+        if (lengths == NULL) return -2;
+        table->lengths = lengths;
+        hashes = (uint32_t *)realloc(table->hashes, new_capacity * sizeof(uint32_t));
+        if (hashes == NULL) return -2;
+        table->hashes = hashes;
+        table->capacity = new_capacity;
+    }
+
+    while (table->arena_size + length + 1 > table->arena_capacity) {
+        char *arena = (char *)realloc(table->arena, table->arena_capacity * 2);
+        if (arena == NULL) return -2;
+        table->arena = arena;
+        table->arena_capacity *= 2;
+    }
+
+    id = table->count++;
+    table->offsets[id] = table->arena_size;
+    table->lengths[id] = (uint32_t)length;
+    table->hashes[id] = hash;
+    memcpy(table->arena + table->arena_size, text, length);
+    table->arena[table->arena_size + length] = '\0';
+    table->arena_size += length + 1;
+    table->slots[slot] = id;
+    return id;
+}
+
+// Function to get the text of an interned string
+const char *string_table_get(const StringTable *table, int id) {
+    return table->arena + table->offsets[id];
+}
+
+// Function to free a string table
+void string_table_free(StringTable *table) {
+    free(table->arena);
+    free(table->offsets);
+    free(table->lengths);
+    free(table->hashes);
+    free(table->slots);
+    memset(table, 0, sizeof(*table));
+}
+
+// Function to create an empty findings store that knows the names of all checks
+// Returns 0 on success, -2 if memory allocation failed
+int finding_store_init(FindingStore *store) {
+    memset(store, 0, sizeof(*store));
+    if (string_table_init(&store->files) != 0 || string_table_init(&store->messages) != 0 ||
+        string_table_init(&store->checks) != 0) {
+        finding_store_free(store);
+        return -2;
+    }
+    for (int i = 0; i < CHECK_COUNT; i++) {
+        if (string_table_intern(&store->checks, check_names[i], strlen(check_names[i])) < 0) {
+            finding_store_free(store);
+            return -2;
+        }
+    }
+    return 0;
+}
+
+// Function to append one finding to the columns
+// Returns 0 on success, -2 if memory allocation failed
+int finding_store_add(FindingStore *store, int file_id, int line_number, int check_id, int message_id, uint16_t line_hash) {
+    if (store->count >= store->capacity) {
+        size_t new_capacity = store->capacity ? store->capacity * 2 : 1024;
+        uint32_t *file_ids = (uint32_t *)realloc(store->file_ids, new_capacity * sizeof(uint32_t));
+        uint32_t *line_numbers, *message_ids;
+        uint16_t *line_hashes;
+        uint8_t *check_ids;
+        if (file_ids == NULL) return -2;
+        store->file_ids = file_ids;
+        line_numbers = (uint32_t *)realloc(store->line_numbers, new_capacity * sizeof(uint32_t));
+        if (line_numbers == NULL) return -2;
+        store->line_numbers = line_numbers;
+        check_ids = (uint8_t *)realloc(store->check_ids, new_capacity * sizeof(uint8_t));
+        if (check_ids == NULL) return -2;
+        store->check_ids = check_ids;
+        message_ids = (uint32_t *)realloc(store->message_ids, new_capacity * sizeof(uint32_t));
+        if (message_ids == NULL) return -2;
+        store->message_ids = message_ids;
+        line_hashes = (uint16_t *)realloc(store->line_hashes, new_capacity * sizeof(uint16_t));
+        if (line_hashes == NULL) return -2;
+        store->line_hashes = line_hashes;
+        store->capacity = new_capacity;
+    }
+    store->file_ids[store->count] = (uint32_t)file_id;
+    store->line_numbers[store->count] = (uint32_t)line_number;
+    store->check_ids[store->count] = (uint8_t)check_id;
+    store->message_ids[store->count] = (uint32_t)message_id;
+    store->line_hashes[store->count] = line_hash;
+    store->count++;
+    return 0;
+}
+
+// Function to free a findings store
+void finding_store_free(FindingStore *store) {
+    string_table_free(&store->files);
+    string_table_free(&store->messages);
+    string_table_free(&store->checks);
+    free(store->file_ids);
+    free(store->line_numbers);
+    free(store->check_ids);
+    free(store->message_ids);
+    free(store->line_hashes);
+    memset(store, 0, sizeof(*store));
+}
+
+// Function to set the file that the next findings belong to, and its lines if they are available
+void set_active_finding_file(const char *filename, const FileLine lines[], int total_lines) {
+    if (active_findings != NULL) {
+        active_file_id = string_table_intern(&active_findings->files, filename, strlen(filename));
+        active_lines = lines;
+        active_line_count = total_lines;
+    }
+}
+
+// Function to hash the text of a line of the active file (FNV-1a, whitespace skipped so reindenting keeps it)
+// The hash is folded to 16 bits, enough to tell apart the nearby lines a diff aligns
+// Returns 0 when the line is not known, such as a line that only held a comment
+static uint16_t active_line_hash(int line_number) {
+    int low = 0, high = active_line_count;
+    uint32_t hash = 2166136261u;
+
+    // Lines are in order, but blank and comment-only lines were left out, so they are searched for
+    while (low < high) {
+        int middle = low + (high - low) / 2;
+        if (active_lines[middle].line_number < line_number) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    if (low == active_line_count || active_lines[low].line_number != line_number) {
+        return 0;
+    }
+    for (const char *c = active_lines[low].line_text; *c != '\0'; c++) {
+        if (!isspace((unsigned char)*c)) {
+            hash = (hash ^ (unsigned char)*c) * 16777619u;
+        }
+    }
+    hash = (hash ^ (hash >> 16)) & 0xffff;
+    return (uint16_t)(hash != 0 ? hash : 1);
+}
+
+// Function to record a finding in the active findings store, if there is one
+void record_finding(int line_number, int check_id, const char *message) {
+    int message_id;
+
+    if (active_findings == NULL || active_file_id < 0) {
+        return;
+    }
+    message_id = string_table_intern(&active_findings->messages, message, strlen(message));
+    if (message_id >= 0) {
+        finding_store_add(active_findings, active_file_id, line_number, check_id, message_id, active_line_hash(line_number));
+    }
+}
+
+// Function to write a finding to the report and record it in the findings store
+void report_finding(FILE *output_file, int line_number, int check_id, const char *format, ...) {
+    char message[1024];
+    va_list arguments;
+
+    va_start(arguments, format);
+    vsnprintf(message, sizeof(message), format, arguments);
+    va_end(arguments);
+
+    fprintf(output_file, "Line %d: %s\n", line_number, message);
+    record_finding(line_number, check_id, message);
+}
+
+// Function to write an unsigned number as a variable-length integer (7 bits per byte)
+static void write_varint(FILE *file, uint64_t value) {
+    while (value >= 0x80) {
+        fputc((int)(value & 0x7f) | 0x80, file);
+        value >>= 7;
+    }
+    fputc((int)value, file);
+}
+
+// Function to read a variable-length integer, checking the bounds of the buffer
+// Returns 0 on success, -1 if the data ends early or the number is too long
+static int read_varint(const unsigned char *data, size_t size, size_t *position, uint64_t *value) {
+    *value = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        unsigned char byte;
+        if (*position >= size) return -1;
+        byte = data[(*position)++];
+        *value |= (uint64_t)(byte & 0x7f) << shift;
+        if (!(byte & 0x80)) return 0;
+    }
+    return -1;
+}
+
+// Function to write the strings of a table in id order
+static void write_string_table(FILE *file, const StringTable *table) {
+    write_varint(file, (uint64_t)table->count);
+    for (int i = 0; i < table->count; i++) {
+        write_varint(file, table->lengths[i]);
+        fwrite(table->arena + table->offsets[i], 1, table->lengths[i], file);
+    }
+}
+
+// Function to read strings into a table, keeping the ids they were written with
+// Returns 0 on success, -2 if memory allocation failed, -3 if the data is malformed
+static int read_string_table(StringTable *table, const unsigned char *data, size_t size, size_t *position) {
+    uint64_t count, length;
+
+    if (read_varint(data, size, position, &count) != 0) return -3;
+    for (uint64_t i = 0; i < count; i++) {
+        int id;
+        if (read_varint(data, size, position, &length) != 0 || length > size - *position) return -3;
+        id = string_table_intern(table, (const char *)data + *position, (size_t)length);
+        if (id == -2) return -2;
+        // Duplicates would break the id mapping
+        if ((uint64_t)id != i) return -3;
+        *position += (size_t)length;
+    }
+    return 0;
+}
+
+// Function to write a findings store as dictionaries followed by one encoded column per field
+// File ids are run-length encoded, line numbers delta encoded, check ids one byte each, message ids varints
+// and line hashes two little-endian bytes each
+// Returns 0 on success, -1 if the file could not be written
+int finding_store_write(const FindingStore *store, const char *filename) {
+    FILE *file = fopen(filename, "wb");
+    size_t runs = 0;
+    uint32_t previous_line = 0;
+
+    if (file == NULL) {
+        return -1;
+    }
+
+    fwrite(FINDINGS_MAGIC, 1, 8, file);
+    write_varint(file, FINDINGS_VERSION);
+    write_string_table(file, &store->checks);
+    write_string_table(file, &store->files);
+    write_string_table(file, &store->messages);
+    write_varint(file, store->count);
+
+    for (size_t i = 0; i < store->count; i++) {
+        if (i == 0 || store->file_ids[i] != store->file_ids[i - 1]) runs++;
+    }
+    write_varint(file, runs);
+    for (size_t i = 0; i < store->count;) {
+        size_t run_end = i;
+        while (run_end < store->count && store->file_ids[run_end] == store->file_ids[i]) run_end++;
+        write_varint(file, store->file_ids[i]);
+        write_varint(file, run_end - i);
+        i = run_end;
+    }
+
+    for (size_t i = 0; i < store->count; i++) {
+        int64_t delta = (int64_t)store->line_numbers[i] - (int64_t)previous_line;
+        write_varint(file, delta >= 0 ? (uint64_t)delta << 1 : ((uint64_t)(-delta) << 1) - 1);
+        previous_line = store->line_numbers[i];
+    }
+    fwrite(store->check_ids, 1, store->count, file);
+    for (size_t i = 0; i < store->count; i++) {
+        write_varint(file, store->message_ids[i]);
+    }
+    for (size_t i = 0; i < store->count; i++) {
+        unsigned char bytes[2] = {(unsigned char)store->line_hashes[i], (unsigned char)(store->line_hashes[i] >> 8)};
+        fwrite(bytes, 1, 2, file);
+    }
+
+    if (ferror(file)) {
+        fclose(file);
+        return -1;
+    }
+    return fclose(file) == 0 ? 0 : -1;
+}
+
+// Function to load a findings store written by finding_store_write
+// Returns 0 on success, -1 if the file could not be read, -2 if memory allocation failed, -3 if it is not a valid store
+int finding_store_read(FindingStore *store, const char *filename) {
+    unsigned char *data = NULL;
+    size_t size = 0, position = 8, filled = 0;
+    uint64_t version, count, runs, value;
+    uint32_t line = 0;
+    int status;
+
+    memset(store, 0, sizeof(*store));
+    status = read_file_contents(filename, (char **)&data, &size);
+    if (status != 0) {
+        return status;
+    }
+    if (size < 8 || memcmp(data, FINDINGS_MAGIC, 8) != 0 ||
+        read_varint(data, size, &position, &version) != 0 || version < 1 || version > FINDINGS_VERSION) {
+        free(data);
+        return -3;
+    }
+
+    if (string_table_init(&store->checks) != 0 || string_table_init(&store->files) != 0 ||
+        string_table_init(&store->messages) != 0) {
+        status = -2;
+    } else if ((status = read_string_table(&store->checks, data, size, &position)) == 0 &&
+               (status = read_string_table(&store->files, data, size, &position)) == 0 &&
+               (status = read_string_table(&store->messages, data, size, &position)) == 0) {
+        status = read_varint(data, size, &position, &count) == 0 && count <= size ? 0 : -3;
+    }
+    if (status == 0) {
+        store->capacity = count > 0 ? (size_t)count : 1;
+        store->file_ids = (uint32_t *)malloc(store->capacity * sizeof(uint32_t));
+        store->line_numbers = (uint32_t *)malloc(store->capacity * sizeof(uint32_t));
+        store->check_ids = (uint8_t *)malloc(store->capacity * sizeof(uint8_t));
+        store->message_ids = (uint32_t *)malloc(store->capacity * sizeof(uint32_t));
+        store->line_hashes = (uint16_t *)calloc(store->capacity, sizeof(uint16_t));
+        if (store->file_ids == NULL || store->line_numbers == NULL || store->check_ids == NULL || store->message_ids == NULL ||
+            store->line_hashes == NULL) {
+            status = -2;
+        }
+    }
+
+    // File id runs
+    if (status == 0 && read_varint(data, size, &position, &runs) != 0) status = -3;
+    for (uint64_t r = 0; status == 0 && r < runs; r++) {
+        uint64_t file_id, length;
+        if (read_varint(data, size, &position, &file_id) != 0 || read_varint(data, size, &position, &length) != 0 ||
+            file_id >= (uint64_t)store->files.count || length > count - filled) {
+            status = -3;
+            break;
+        }
+        for (uint64_t i = 0; i < length; i++) {
+            store->file_ids[filled++] = (uint32_t)file_id;
+        }
+    }
+    if (status == 0 && filled != count) status = -3;
+
+    // Line deltas, check ids and message ids
+    for (size_t i = 0; status == 0 && i < count; i++) {
+        if (read_varint(data, size, &position, &value) != 0) {
+            status = -3;
+            break;
+        }
+        line = (uint32_t)((int64_t)line + ((value & 1) ? -(int64_t)((value + 1) >> 1) : (int64_t)(value >> 1)));
+        store->line_numbers[i] = line;
+    }
+    if (status == 0 && size - position < count) status = -3;
+    if (status == 0) {
+        memcpy(store->check_ids, data + position, (size_t)count);
+        position += (size_t)count;
+    }
+    for (size_t i = 0; status == 0 && i < count; i++) {
+        if (store->check_ids[i] >= store->checks.count || read_varint(data, size, &position, &value) != 0 ||
+            value >= (uint64_t)store->messages.count) {
+            status = -3;
+            break;
+        }
+        store->message_ids[i] = (uint32_t)value;
+    }
+    // Version 1 stores have no line hashes, so their findings align by line offset alone
+    if (status == 0 && version >= 2) {
+        if (size - position < count * 2) {
+            status = -3;
+        }
+        for (size_t i = 0; status == 0 && i < count; i++, position += 2) {
+            store->line_hashes[i] = (uint16_t)(data[position] | data[position + 1] << 8);
+        }
+    }
+
+    free(data);
+    if (status != 0) {
+        finding_store_free(store);
+        return status;
+    }
+    store->count = (size_t)count;
+    return 0;
+}
+
+// A count of findings for one file or check, used to rank query results
+typedef struct {
+    int id;
+    size_t count;
+} FindingCount;
+
+// A finding keyed by ids that are comparable between two stores
+typedef struct {
+    uint32_t file_id;
+    uint32_t check_id;
+    uint32_t message_id;
+    uint32_t line_number;
+    uint16_t line_hash;
+} FindingKey;
+
+// Function to rank counts from most to fewest findings
+static int compare_finding_counts(const void *left, const void *right) {
+    const FindingCount *a = (const FindingCount *)left;
+    const FindingCount *b = (const FindingCount *)right;
+    if (a->count != b->count) return a->count < b->count ? 1 : -1;
+    return a->id - b->id;
+}
+
+// Function to order finding keys so equal findings of two runs line up
+static int compare_finding_keys(const void *left, const void *right) {
+    const FindingKey *a = (const FindingKey *)left;
+    const FindingKey *b = (const FindingKey *)right;
+    if (a->file_id != b->file_id) return a->file_id < b->file_id ? -1 : 1;
+    if (a->check_id != b->check_id) return a->check_id < b->check_id ? -1 : 1;
+    if (a->message_id != b->message_id) return a->message_id < b->message_id ? -1 : 1;
+    if (a->line_number != b->line_number) return a->line_number < b->line_number ? -1 : 1;
+    return 0;
+}
+
+// Function to load a findings store for a subcommand, explaining any failure
+static int load_findings_for_query(FindingStore *store, const char *filename) {
+    int status = finding_store_read(store, filename);
+    if (status == -1) {
+        printf("Error: Could not read findings store %s.\n", filename);
+    } else if (status == -2) {
+        printf("Error: Memory allocation failed.\n");
+    } else if (status == -3) {
+        printf("Error: %s is not a valid findings store.\n", filename);
+    }
+    return status;
+}
+
+// Function to answer "query <store> checks|files|top [n]"
+// checks: findings per check, files: findings per file, top: the n files with the most findings
+int run_findings_query(int argc, char *argv[]) {
+    FindingStore store;
+    FindingCount *counts;
+    int by_check, limit, group_count;
+
+    if (argc < 2 || (strcmp(argv[1], "checks") != 0 && strcmp(argv[1], "files") != 0 && strcmp(argv[1], "top") != 0)) {
+        printf("Usage: query <findings_store> checks | files | top [n]\n");
+        return 1;
+    }
+    if (load_findings_for_query(&store, argv[0]) != 0) {
+        return 1;
+    }
+
+    by_check = strcmp(argv[1], "checks") == 0;
+    group_count = by_check ? store.checks.count : store.files.count;
+    limit = strcmp(argv[1], "top") == 0 ? (argc > 2 ? atoi(argv[2]) : 10) : group_count;
+
+    counts = (FindingCount *)calloc(group_count > 0 ? group_count : 1, sizeof(FindingCount));
+    if (counts == NULL) {
+        printf("Error: Memory allocation failed.\n");
+        finding_store_free(&store);
+        return 1;
+    }
+    for (int i = 0; i < group_count; i++) {
+        counts[i].id = i;
+    }
+    for (size_t i = 0; i < store.count; i++) {
+        counts[by_check ? store.check_ids[i] : store.file_ids[i]].count++;
+    }
+    qsort(counts, group_count, sizeof(FindingCount), compare_finding_counts);
+
+    printf("Total findings: %zu in %d files\n", store.count, store.files.count);
+    for (int i = 0; i < group_count && i < limit; i++) {
+        if (counts[i].count == 0) break;
+        printf("%8zu  %s\n", counts[i].count, string_table_get(by_check ? &store.checks : &store.files, counts[i].id));
+    }
+
+    free(counts);
+    finding_store_free(&store);
+    return 0;
+}
+
+// Function to express every finding of a store with the string ids of another store
+// Strings the other store has never seen are added to it, so they still compare unequal
+static FindingKey *build_finding_keys(const FindingStore *source, FindingStore *target) {
+    FindingKey *keys = (FindingKey *)malloc((source->count > 0 ? source->count : 1) * sizeof(FindingKey));
+    int *file_map = (int *)malloc((source->files.count + 1) * sizeof(int));
+    int *check_map = (int *)malloc((source->checks.count + 1) * sizeof(int));
+    int *message_map = (int *)malloc((source->messages.count + 1) * sizeof(int));
+    int failed = keys == NULL || file_map == NULL || check_map == NULL || message_map == NULL;
+
+    for (int i = 0; !failed && i < source->files.count; i++) {
+        file_map[i] = string_table_intern(&target->files, string_table_get(&source->files, i), source->files.lengths[i]);
+        failed = file_map[i] < 0;
+    }
+    for (int i = 0; !failed && i < source->checks.count; i++) {
+        check_map[i] = string_table_intern(&target->checks, string_table_get(&source->checks, i), source->checks.lengths[i]);
+        failed = check_map[i] < 0;
+    }
+    for (int i = 0; !failed && i < source->messages.count; i++) {
+        message_map[i] = string_table_intern(&target->messages, string_table_get(&source->messages, i), source->messages.lengths[i]);
+        failed = message_map[i] < 0;
+    }
+    for (size_t i = 0; !failed && i < source->count; i++) {
+        keys[i].file_id = (uint32_t)file_map[source->file_ids[i]];
+        keys[i].check_id = (uint32_t)check_map[source->check_ids[i]];
+        keys[i].message_id = (uint32_t)message_map[source->message_ids[i]];
+        keys[i].line_number = source->line_numbers[i];
+        keys[i].line_hash = source->line_hashes[i];
+    }
+
+    free(file_map);
+    free(check_map);
+    free(message_map);
+    if (failed) {
+        free(keys);
+        return NULL;
+    }
+    if (source->count > 0) {
+        qsort(keys, source->count, sizeof(FindingKey), compare_finding_keys);
+    }
+    return keys;
+}
+
+// Function to check if two findings have the same file, check and message, whatever their lines
+static int same_finding(const FindingKey *a, const FindingKey *b) {
+    return a->file_id == b->file_id && a->check_id == b->check_id && a->message_id == b->message_id;
+}
+
+// Function to print one finding from a diff
+static void print_finding_key(const char *label, const FindingStore *store, const FindingKey *key) {
+    printf("%s: %s:%u: [%s] %s\n", label, string_table_get(&store->files, (int)key->file_id), key->line_number,
+           string_table_get(&store->checks, (int)key->check_id), string_table_get(&store->messages, (int)key->message_id));
+}
+
+// Function to get the line offset between finding a of the short side and finding a + d of the long side
+static int64_t row_offset(const FindingKey *long_keys, const FindingKey *short_keys, size_t a, size_t d) {
+    return (int64_t)long_keys[a + d].line_number - (int64_t)short_keys[a].line_number;
+}
+
+// Function to check if two findings were recorded on lines with different text
+static int line_text_differs(const FindingKey *a, const FindingKey *b) {
+    return a->line_hash != 0 && b->line_hash != 0 && a->line_hash != b->line_hash;
+}
+
+// Function to pair the findings of one group between the two runs, keeping both in line order
+// The smaller side is paired completely. The findings left out of the larger side are chosen so paired
+// findings sit on lines with the same text, then so the line offset between them changes as rarely as
+// possible, since added or removed code shifts every later finding by the same amount, and then so they
+// form as few separate stretches as possible
+// Returns 0 on success, -2 if memory allocation failed
+static int pair_by_line_offset(FindingKey *old_keys, size_t old_count, FindingKey *new_keys, size_t new_count) {
+    FindingKey *short_keys = old_count <= new_count ? old_keys : new_keys;
+    FindingKey *long_keys = old_count <= new_count ? new_keys : old_keys;
+    size_t short_count = old_count <= new_count ? old_count : new_count;
+    size_t skips = old_count <= new_count ? new_count - old_count : old_count - new_count;
+    // Each cost outweighs any number of the cheaper ones: there are at most short_count + 1 gaps
+    // and short_count changes of offset, and the limit keeps short_count below 2^21 so the sums fit
+    uint64_t shift_cost = (uint64_t)short_count + 2, mismatch_cost = shift_cost * (short_count + 1);
+    uint64_t *costs, *previous;
+    uint32_t *choices;
+    size_t skip = 0;
+
+    // Without findings to leave out, or with too many combinations to try, the findings pair in order
+    if (short_count == 0 || skips == 0 || short_count * (skips + 1) > DIFF_ALIGN_LIMIT) {
+        for (size_t a = 0; a < short_count; a++) {
+            short_keys[a].line_number |= DIFF_MATCHED;
+            long_keys[a].line_number |= DIFF_MATCHED;
+        }
+        return 0;
+    }
+
+    costs = (uint64_t *)malloc((skips + 1) * sizeof(uint64_t));
+    previous = (uint64_t *)malloc((skips + 1) * sizeof(uint64_t));
+    choices = (uint32_t *)malloc(short_count * (skips + 1) * sizeof(uint32_t));
+    if (costs == NULL || previous == NULL || choices == NULL) {
+        free(costs);
+        free(previous);
+        free(choices);
+        return -2;
+    }
+
+    // Finding a of the short side pairs with finding a + d of the long side, where d never decreases
+    // costs[d] is the cheapest way to pair findings 0..a with a paired at a + d, counting mismatch_cost
+    // per pair on lines with different text, shift_cost per change of offset (the offset starts at 0)
+    // and 1 per gap of left out findings, and choices[a][d] is the d that finding a - 1 is paired at on that path
+    // Remaining ties, such as runs of findings on identical lines, go to leaving findings out as early as possible
+    for (size_t a = 0; a < short_count; a++) {
+        uint32_t *row = choices + a * (skips + 1);
+        uint64_t below = UINT64_MAX;
+        size_t below_choice = 0, same = 0;
+        for (size_t d = 0; d <= skips; d++) {
+            int64_t offset = row_offset(long_keys, short_keys, a, d);
+            uint64_t mismatch = line_text_differs(&long_keys[a + d], &short_keys[a]) ? mismatch_cost : 0;
+            if (a == 0) {
+                costs[d] = (offset != 0 ? shift_cost : 0) + (d > 0 ? 1 : 0) + mismatch;
+                row[d] = 0;
+                continue;
+            }
+            // Staying at the same skip count leaves no gap
+            costs[d] = previous[d] + (offset != row_offset(long_keys, short_keys, a - 1, d) ? shift_cost : 0) + mismatch;
+            row[d] = (uint32_t)d;
+            if (d == 0) {
+                continue;
+            }
+            // A smaller skip count leaves a gap, and shifts unless it kept the same offset
+            if (previous[d - 1] <= below) {
+                below = previous[d - 1];
+                below_choice = d - 1;
+            }
+            if (below + 1 + shift_cost + mismatch < costs[d]) {
+                costs[d] = below + 1 + shift_cost + mismatch;
+                row[d] = (uint32_t)below_choice;
+            }
+            while (same < d && row_offset(long_keys, short_keys, a - 1, same) < offset) same++;
+            for (size_t e = same; e < d && row_offset(long_keys, short_keys, a - 1, e) == offset; e++) {
+                if (previous[e] + 1 + mismatch < costs[d] || (previous[e] + 1 + mismatch == costs[d] && e > row[d])) {
+                    costs[d] = previous[e] + 1 + mismatch;
+                    row[d] = (uint32_t)e;
+                }
+            }
+        }
+        memcpy(previous, costs, (skips + 1) * sizeof(uint64_t));
+    }
+
+    // Follow the cheapest path back from the last finding of the short side
+    for (size_t d = 1; d <= skips; d++) {
+        if (costs[d] + (d < skips ? 1 : 0) <= costs[skip] + (skip < skips ? 1 : 0)) skip = d;
+    }
+    for (size_t a = short_count; a-- > 0;) {
+        short_keys[a].line_number |= DIFF_MATCHED;
+        long_keys[a + skip].line_number |= DIFF_MATCHED;
+        skip = choices[a * (skips + 1) + skip];
+    }
+
+    free(costs);
+    free(previous);
+    free(choices);
+    return 0;
+}
+
+// Function to answer "diff <old_store> <new_store>" without re-running the analysis
+// Findings match when file, check and message are equal; repeated findings are aligned by their line offset,
+// so code that only moved is not reported. Returns 1 when the new run has findings the old one did not
+int run_findings_diff(int argc, char *argv[]) {
+    FindingStore old_store, new_store;
+    FindingKey *old_keys, *new_keys;
+    size_t i = 0, j = 0, added = 0, fixed = 0;
+    int failed = 0;
+
+    if (argc < 2) {
+        printf("Usage: diff <old_findings_store> <new_findings_store>\n");
+        return 1;
+    }
+    if (load_findings_for_query(&old_store, argv[0]) != 0) {
+        return 1;
+    }
+    if (load_findings_for_query(&new_store, argv[1]) != 0) {
+        finding_store_free(&old_store);
+        return 1;
+    }
+
+    // Both runs are compared in the id space of the new store
+    new_keys = build_finding_keys(&new_store, &new_store);
+    old_keys = new_keys != NULL ? build_finding_keys(&old_store, &new_store) : NULL;
+    if (old_keys == NULL) {
+        printf("Error: Memory allocation failed.\n");
+        free(new_keys);
+        finding_store_free(&old_store);
+        finding_store_free(&new_store);
+        return 1;
+    }
+
+    // Walk both runs one group of equal file, check and message at a time
+    while (i < old_store.count || j < new_store.count) {
+        size_t old_end = i, new_end = j, old_pos, new_pos;
+        const FindingKey *group;
+        FindingKey group_key;
+
+        if (i == old_store.count) {
+            group = &new_keys[j];
+        } else if (j == new_store.count) {
+            group = &old_keys[i];
+        } else {
+            group = compare_finding_keys(&old_keys[i], &new_keys[j]) <= 0 ? &old_keys[i] : &new_keys[j];
+        }
+        group_key = *group;
+        group_key.line_number = 0;
+        while (old_end < old_store.count && same_finding(&old_keys[old_end], &group_key)) old_end++;
+        while (new_end < new_store.count && same_finding(&new_keys[new_end], &group_key)) new_end++;
+
+        // An added finding is reported where it appeared and code that only moved is not reported
+        if (pair_by_line_offset(old_keys + i, old_end - i, new_keys + j, new_end - j) != 0) {
+            printf("Error: Memory allocation failed.\n");
+            failed = 1;
+            break;
+        }
+        for (old_pos = i; old_pos < old_end; old_pos++) {
+            if (!(old_keys[old_pos].line_number & DIFF_MATCHED)) {
+                print_finding_key("Fixed", &new_store, &old_keys[old_pos]);
+                fixed++;
+            }
+        }
+        for (new_pos = j; new_pos < new_end; new_pos++) {
+            if (!(new_keys[new_pos].line_number & DIFF_MATCHED)) {
+                print_finding_key("New", &new_store, &new_keys[new_pos]);
+                added++;
+            }
+        }
+        i = old_end;
+        j = new_end;
+    }
+    if (!failed) {
+        printf("%zu new, %zu fixed\n", added, fixed);
+    }
+
+    free(old_keys);
+    free(new_keys);
+    finding_store_free(&old_store);
+    finding_store_free(&new_store);
+    return failed || added > 0 ? 1 : 0;
+}
+
+// Function to intern a list of keywords
+// Returns 0 on success, -2 if memory allocation failed
+static int intern_keywords(StringTable *table, const char *keywords[], int count) {
+    for (int i = 0; i < count; i++) {
+        if (string_table_intern(table, keywords[i], strlen(keywords[i])) < 0) {
+            return -2;
+        }
+    }
+    return 0;
+}
+
+// Function to create the state of a declaration pass, with the keywords interned first so their ids are ranges
+// Returns 0 on success, -2 if memory allocation failed
+int declaration_pass_init(DeclarationPass *pass, int is_cpp) {
+    static const char *c_types[] = {"void", "char", "short", "int", "long", "float", "double", "signed", "unsigned", "_Bool", "_Complex", "bool"};
+    static const char *cpp_types[] = {"auto", "wchar_t", "char16_t", "char32_t"};
+    static const char *c_qualifiers[] = {"auto", "const", "volatile", "static", "extern", "register", "inline", "restrict",
+                                         "typedef", "_Atomic", "_Thread_local", "__restrict", "__inline"};
+    static const char *cpp_qualifiers[] = {"const", "volatile", "static", "extern", "register", "inline", "typedef", "mutable",
+                                           "constexpr", "virtual", "explicit", "friend", "thread_local", "typename"};
+    static const char *c_tags[] = {"struct", "union", "enum"};
+    static const char *cpp_tags[] = {"struct", "union", "enum", "class"};
+    static const char *controls[] = {"if", "while", "switch"};
+    static const char *prefixes[] = {"else", "do"};
+    static const char *c_labels[] = {"case", "default"};
+    static const char *cpp_labels[] = {"case", "default", "public", "private", "protected"};
+    static const char *c_others[] = {"for", "return", "break", "continue", "goto", "sizeof", "_Alignof", "_Static_assert", "_Generic"};
+    static const char *cpp_others[] = {"for", "return", "break", "continue", "goto", "sizeof", "namespace", "template", "new",
+                                       "delete", "this", "operator", "using", "try", "catch", "throw", "nullptr", "true",
+                                       "false", "static_assert", "decltype", "noexcept", "override", "final", "alignof"};
+#define INTERN_KEYWORDS(list) intern_keywords(&pass->names, list, (int)(sizeof(list) / sizeof(list[0])))
+    int status;
+
+    memset(pass, 0, sizeof(*pass));
+    pass->pending_function = -1;
+    pass->is_cpp = is_cpp;
+    if (string_table_init(&pass->names) != 0) {
+        return -2;
+    }
+
+    status = is_cpp ? INTERN_KEYWORDS(c_types) | INTERN_KEYWORDS(cpp_types) : INTERN_KEYWORDS(c_types);
+    pass->type_keywords = pass->names.count;
+    status |= is_cpp ? INTERN_KEYWORDS(cpp_qualifiers) : INTERN_KEYWORDS(c_qualifiers);
+    pass->qualifier_keywords = pass->names.count;
+    status |= is_cpp ? INTERN_KEYWORDS(cpp_tags) : INTERN_KEYWORDS(c_tags);
+    pass->tag_keywords = pass->names.count;
+    status |= INTERN_KEYWORDS(controls);
+    pass->control_keywords = pass->names.count;
+    status |= INTERN_KEYWORDS(prefixes);
+    pass->prefix_keywords = pass->names.count;
+    status |= is_cpp ? INTERN_KEYWORDS(cpp_labels) : INTERN_KEYWORDS(c_labels);
+    pass->label_keywords = pass->names.count;
+    status |= is_cpp ? INTERN_KEYWORDS(cpp_others) : INTERN_KEYWORDS(c_others);
+    pass->keyword_count = pass->names.count;
+#undef INTERN_KEYWORDS
+    if (status != 0) {
+        declaration_pass_free(pass);
+        return -2;
+    }
+
+    pass->typedef_id = string_table_find(&pass->names, "typedef", 7);
+    pass->enum_id = string_table_find(&pass->names, "enum", 4);
+    pass->for_id = string_table_find(&pass->names, "for", 3);
+    pass->else_id = string_table_find(&pass->names, "else", 4);
+    pass->namespace_id = string_table_find(&pass->names, "namespace", 9);
+    pass->extern_id = string_table_find(&pass->names, "extern", 6);
+    pass->template_id = string_table_find(&pass->names, "template", 8);
+    return 0;
+}
+
+// Function to free the state of a declaration pass
+void declaration_pass_free(DeclarationPass *pass) {
+    string_table_free(&pass->names);
+    free(pass->bindings);
+    free(pass->declarations);
+    free(pass->scopes);
+    free(pass->functions);
+    free(pass->findings);
+    free(pass->tokens);
+    free(pass->pending_parameters);
+    free(pass->pending_uses);
+    memset(pass, 0, sizeof(*pass));
+}
+
+// Function to make room for one more element at the end of an array of the pass
+// Returns 0 on success, -2 if memory allocation failed (the pass is marked failed)
+static int declaration_pass_reserve(DeclarationPass *pass, void **array, int *capacity, int count, size_t element_size) {
+    int new_capacity;
+    void *resized;
+
+    if (count < *capacity) {
+        return 0;
+    }
+    new_capacity = *capacity > 0 ? *capacity * 2 : 64;
+    resized = realloc(*array, (size_t)new_capacity * element_size);
+    if (resized == NULL) {
+        pass->failed = 1;
+        return -2;
+    }
+    *array = resized;
+    *capacity = new_capacity;
+    return 0;
+}
+
+// Function to get the name id of an identifier token, growing the bindings to cover it
+// Returns the id, or -1 if memory allocation failed
+static int declaration_name(DeclarationPass *pass, const SourceToken *token) {
+    int id = string_table_intern(&pass->names, token->text, (size_t)token->length);
+
+    if (id < 0) {
+        pass->failed = 1;
+        return -1;
+    }
+    while (id >= pass->binding_capacity) {
+        int old_capacity = pass->binding_capacity;
+        if (declaration_pass_reserve(pass, (void **)&pass->bindings, &pass->binding_capacity, old_capacity, sizeof(int)) != 0) {
+            return -1;
+        }
+        for (int i = old_capacity; i < pass->binding_capacity; i++) {
+            pass->bindings[i] = -1;
+        }
+    }
+    return id;
+}
+
+// Function to get a token by its number in the file, scanning more lines as needed
+// Returns NULL past the last token; the pointer stays valid until the next call
+static SourceToken *token_at(DeclarationPass *pass, int index) {
+    while (index >= pass->token_base + pass->token_count) {
+        FileLine *line;
+        int position = 0;
+
+        if (pass->next_line >= pass->total_lines || pass->failed) {
+            return NULL;
+        }
+        line = &pass->lines[pass->next_line++];
+        if (pass->in_directive || (!pass->in_block_comment && is_preprocessor_line(line))) {
+            int end = line->line_length;
+            while (end > 0 && isspace((unsigned char)line->line_text[end - 1])) end--;
+            pass->in_directive = end > 0 && line->line_text[end - 1] == '\\';
+            continue;
+        }
+        for (;;) {
+            if (declaration_pass_reserve(pass, (void **)&pass->tokens, &pass->token_capacity, pass->token_count, sizeof(SourceToken)) != 0) {
+                return NULL;
+            }
+            if (!next_source_token(line, &position, &pass->in_block_comment, &pass->tokens[pass->token_count])) {
+                break;
+            }
+            pass->token_count++;
+        }
+    }
+    if (index < pass->token_base) {
+        return NULL;
+    }
+    return &pass->tokens[index - pass->token_base];
+}
+
+// Function to drop the scanned tokens before an index, keeping the few that are looked back at
+static void release_tokens(DeclarationPass *pass, int index) {
+    int drop = index - DECLARATION_LOOKBEHIND - pass->token_base;
+
+    if (drop > pass->token_count) drop = pass->token_count;
+    // Compacting only once the dropped part outweighs the rest keeps the copying linear overall
+    if (drop <= 0 || drop < pass->token_count - drop) {
+        return;
+    }
+    memmove(pass->tokens, pass->tokens + drop, (size_t)(pass->token_count - drop) * sizeof(SourceToken));
+    pass->token_base += drop;
+    pass->token_count -= drop;
+}
+
+// Function to get the name id of the token at an index if it is an identifier
+// Returns the id, or -1 if the index is past the end or the token is not an identifier
+static int identifier_at(DeclarationPass *pass, int index) {
+    SourceToken *token = token_at(pass, index);
+
+    if (token == NULL || token->kind != TOKEN_IDENTIFIER) {
+        return -1;
+    }
+    return declaration_name(pass, token);
+}
+
+// Function to check if the token at an index is an identifier that is not a keyword
+static int is_name_at(DeclarationPass *pass, int index) {
+    return identifier_at(pass, index) >= pass->keyword_count;
+}
+
+// Function to check if the token at an index is the given punctuation character
+static int is_punctuation_at(DeclarationPass *pass, int index, char c) {
+    SourceToken *token = token_at(pass, index);
+    return token != NULL && token->kind == TOKEN_PUNCTUATION && token->text[0] == c;
+}
+
+// Function to check if an identifier is reached through an object or a qualifier (a.name, p->name, X::name)
+static int is_member_access(DeclarationPass *pass, int index) {
+    if (index >= 1 && is_punctuation_at(pass, index - 1, '.')) {
+        return 1;
+    }
+    return index >= 2 && ((is_punctuation_at(pass, index - 1, '>') && is_punctuation_at(pass, index - 2, '-')) ||
+                          (is_punctuation_at(pass, index - 1, ':') && is_punctuation_at(pass, index - 2, ':')));
+}
+
+// Function to skip a bracketed group starting at an opening (, [ or {
+// Returns the index after the matching closing bracket
+static int skip_brackets(DeclarationPass *pass, int index) {
+    SourceToken *token;
+    int depth = 0;
+
+    for (; (token = token_at(pass, index)) != NULL; index++) {
+        if (token->kind != TOKEN_PUNCTUATION) continue;
+        char c = token->text[0];
+        if (c == '(' || c == '[' || c == '{') {
+            depth++;
+        } else if ((c == ')' || c == ']' || c == '}') && --depth == 0) {
+            return index + 1;
+        }
+    }
+    return index;
+}
+
+// Function to skip a template argument list starting at <
+// Returns the index after the matching >, or the starting index if the list does not close within the statement
+static int skip_template_arguments(DeclarationPass *pass, int index) {
+    int depth = 0;
+
+    for (int i = index; token_at(pass, i) != NULL; i++) {
+        if (is_punctuation_at(pass, i, '<')) {
+            depth++;
+        } else if (is_punctuation_at(pass, i, '>')) {
+            if (--depth == 0) return i + 1;
+        } else if (is_punctuation_at(pass, i, ';') || is_punctuation_at(pass, i, '{')) {
+            break;
+        }
+    }
+    return index;
+}
+
+// Function to mark a name as used by its innermost live declaration
+static void mark_name_used(DeclarationPass *pass, int name_id) {
+    int declaration = pass->bindings[name_id];
+    if (declaration >= 0) {
+        pass->declarations[declaration].used = 1;
+    }
+}
+
+// Function to mark the names used in an expression, up to a , or ; outside brackets
+// Returns the index of the token that ended the expression
+static int mark_expression_uses(DeclarationPass *pass, int index) {
+    SourceToken *token;
+    int depth = 0;
+
+    for (; (token = token_at(pass, index)) != NULL; index++) {
+        if (token->kind == TOKEN_PUNCTUATION) {
+            char c = token->text[0];
+            if (c == '(' || c == '[' || c == '{') {
+                depth++;
+            } else if (c == ')' || c == ']' || c == '}') {
+                if (depth == 0) break;
+                depth--;
+            } else if ((c == ',' || c == ';') && depth == 0) {
+                break;
+            }
+        } else if (token->kind == TOKEN_IDENTIFIER && !is_member_access(pass, index)) {
+            int id = declaration_name(pass, token);
+            if (id >= pass->keyword_count) mark_name_used(pass, id);
+        }
+    }
+    return index;
+}
+
+// Function to record an unused or shadowing declaration
+static void add_declaration_finding(DeclarationPass *pass, int line_number, int check_id, int name_id, int detail) {
+    DeclarationFinding *finding;
+
+    if (declaration_pass_reserve(pass, (void **)&pass->findings, &pass->finding_capacity, pass->finding_count, sizeof(DeclarationFinding)) != 0) {
+        return;
+    }
+    finding = &pass->findings[pass->finding_count];
+    finding->line_number = line_number;
+    finding->check_id = check_id;
+    finding->name_id = name_id;
+    finding->detail = detail;
+    finding->order = pass->finding_count++;
+}
+
+// Function to get the function that the innermost scope belongs to, -1 outside functions
+static int current_function(DeclarationPass *pass) {
+    return pass->scope_count > 0 ? pass->scopes[pass->scope_count - 1].function : -1;
+}
+
+// Function to open a scope; its declarations start at the current top of the declaration stack
+static void push_scope(DeclarationPass *pass, int kind, int function, int paren_depth) {
+    Scope *scope;
+
+    if (declaration_pass_reserve(pass, (void **)&pass->scopes, &pass->scope_capacity, pass->scope_count, sizeof(Scope)) != 0) {
+        return;
+    }
+    scope = &pass->scopes[pass->scope_count++];
+    scope->kind = kind;
+    scope->first_declaration = pass->declaration_count;
+    scope->function = function;
+    scope->paren_depth = paren_depth;
+    scope->state = 0;
+}
+
+// Function to close the innermost scope: report its unused names, restore the names it hid and drop its declarations
+static void pop_scope(DeclarationPass *pass) {
+    Scope *scope = &pass->scopes[pass->scope_count - 1];
+
+    for (int i = pass->declaration_count - 1; i >= scope->first_declaration; i--) {
+        Declaration *declaration = &pass->declarations[i];
+        // Names at file scope may be used by other files
+        if (!declaration->used && declaration->kind != DECLARATION_TYPE && scope->kind != SCOPE_FILE) {
+            add_declaration_finding(pass, declaration->line_number, CHECK_UNUSED, declaration->name_id, declaration->kind);
+        }
+        pass->bindings[declaration->name_id] = declaration->previous;
+    }
+    pass->declaration_count = scope->first_declaration;
+    pass->scope_count--;
+}
+
+// Function to declare a name in the innermost scope
+static void declare_name(DeclarationPass *pass, int name_id, int line_number, int kind) {
+    int scope = pass->scope_count - 1;
+    int previous = pass->bindings[name_id];
+    int function = pass->scopes[scope].function;
+    Declaration *declaration;
+
+    // Members are reached through their object, not by name
+    if (pass->scopes[scope].kind == SCOPE_MEMBERS) {
+        return;
+    }
+    // Declaring a name again in the same scope adds nothing
+    if (previous >= 0 && pass->declarations[previous].scope == scope) {
+        return;
+    }
+    if (previous >= 0 && kind != DECLARATION_TYPE && pass->declarations[previous].kind != DECLARATION_TYPE) {
+        add_declaration_finding(pass, line_number, CHECK_SHADOW, name_id, pass->declarations[previous].line_number);
+    }
+
+    if (declaration_pass_reserve(pass, (void **)&pass->declarations, &pass->declaration_capacity, pass->declaration_count, sizeof(Declaration)) != 0) {
+        return;
+    }
+    declaration = &pass->declarations[pass->declaration_count];
+    declaration->name_id = name_id;
+    declaration->line_number = line_number;
+    declaration->previous = previous;
+    declaration->scope = scope;
+    declaration->kind = (uint8_t)kind;
+    declaration->used = 0;
+    pass->bindings[name_id] = pass->declaration_count++;
+
+    if (kind == DECLARATION_VARIABLE) {
+        pass->variable_count++;
+        if (function >= 0) pass->functions[function].locals++;
+    } else if (kind == DECLARATION_PARAMETER) {
+        pass->parameter_count++;
+        if (function >= 0) pass->functions[function].parameters++;
+    }
+}
+
+// Function to keep the parameter named by the token at name_index until the function body opens
+static void add_parameter_name(DeclarationPass *pass, int name_index) {
+    if (declaration_pass_reserve(pass, (void **)&pass->pending_parameters, &pass->pending_capacity, pass->pending_count + 1, sizeof(int)) == 0) {
+        SourceToken *name = token_at(pass, name_index);
+        pass->pending_parameters[pass->pending_count++] = declaration_name(pass, name);
+        pass->pending_parameters[pass->pending_count++] = name->line_number;
+    }
+}
+
+// Function to find the name of one parameter in the tokens between two commas of a parameter list
+static void add_parameter(DeclarationPass *pass, int start, int end) {
+    int depth = 0, words = 0, name_index = -1;
+
+    for (int i = start; i < end; i++) {
+        SourceToken *token = token_at(pass, i);
+        int id;
+
+        if (token->kind == TOKEN_PUNCTUATION) {
+            char c = token->text[0];
+            // Function pointer parameter: (*name)
+            if (c == '(' && depth == 0 && is_punctuation_at(pass, i + 1, '*') && is_name_at(pass, i + 2) &&
+                is_punctuation_at(pass, i + 3, ')')) {
+                name_index = i + 2;
+                break;
+            }
+            if (c == '=' && depth == 0) break; // Default argument
+            if (c == '(' || c == '[' || c == '<') depth++;
+            if (c == ')' || c == ']' || c == '>') depth--;
+            continue;
+        }
+        if (token->kind != TOKEN_IDENTIFIER || depth != 0) continue;
+        id = declaration_name(pass, token);
+        if (id < 0) return;
+        if (id >= pass->keyword_count) {
+            // The last name after at least one type word is the parameter, unless a macro wraps it
+            if (words > 0) name_index = is_punctuation_at(pass, i + 1, '(') ? -1 : i;
+            words++;
+        } else if (id < pass->tag_keywords) {
+            words++;
+        }
+    }
+
+    if (name_index >= 0) {
+        add_parameter_name(pass, name_index);
+    }
+}
+
+// Function to collect the parameter names of a parameter list starting at (
+// Returns the index after the closing )
+static int parse_parameters(DeclarationPass *pass, int index) {
+    SourceToken *token;
+    int depth = 0, start = index + 1;
+
+    pass->pending_count = 0;
+    for (; (token = token_at(pass, index)) != NULL; index++) {
+        if (token->kind != TOKEN_PUNCTUATION) continue;
+        char c = token->text[0];
+        if (c == '(' || c == '[' || c == '{') {
+            depth++;
+        } else if (c == ')' || c == ']' || c == '}') {
+            if (--depth == 0) {
+                add_parameter(pass, start, index);
+                return index + 1;
+            }
+        } else if (c == ',' && depth == 1) {
+            add_parameter(pass, start, index);
+            start = index + 1;
+        }
+    }
+    return index;
+}
+
+// Function to read the parameter declarations of an old-style definition such as int f(a, b) int a; char *b; {
+// open is the ( of its identifier list and index the token after the ); the listed names become the parameters
+// Returns the index of the { that starts the body, or index if the declarator is not such a definition
+static int parse_old_style_parameters(DeclarationPass *pass, int open, int index) {
+    int body = index;
+
+    if (index - 1 <= open + 1) {
+        return index;
+    }
+    for (int i = open + 1; i < index - 1; i += 2) {
+        if (identifier_at(pass, i) < pass->keyword_count || !(i + 1 == index - 1 || is_punctuation_at(pass, i + 1, ','))) {
+            return index;
+        }
+    }
+    // Each declaration up to the body names a listed parameter; anything else is a prototype followed by other code
+    while (token_at(pass, body) != NULL && !is_punctuation_at(pass, body, '{')) {
+        int listed = 0;
+
+        for (; token_at(pass, body) != NULL && !is_punctuation_at(pass, body, ';'); body++) {
+            int id = identifier_at(pass, body);
+            if (is_punctuation_at(pass, body, '{') || is_punctuation_at(pass, body, '}') || is_punctuation_at(pass, body, '=')) {
+                return index;
+            }
+            for (int i = open + 1; id >= 0 && i < index - 1 && !listed; i += 2) {
+                listed = identifier_at(pass, i) == id;
+            }
+        }
+        if (!listed || token_at(pass, body) == NULL) {
+            return index;
+        }
+        body++;
+    }
+    if (token_at(pass, body) == NULL) {
+        return index;
+    }
+    for (int i = open + 1; i < index - 1; i += 2) {
+        add_parameter_name(pass, i);
+    }
+    return body;
+}
+
+// Function to read a constructor initializer list, starting after its :
+// Its parameters are not declared until the body opens, so the names in the member arguments are kept for then
+// Returns the index of the { that starts the body, or of the token that ended the list
+static int parse_initializer_list(DeclarationPass *pass, int index) {
+    while (token_at(pass, index) != NULL && !is_punctuation_at(pass, index, ';')) {
+        if (is_punctuation_at(pass, index, '(') ||
+            (is_punctuation_at(pass, index, '{') && (is_name_at(pass, index - 1) || is_punctuation_at(pass, index - 1, '>')))) {
+            for (int end = skip_brackets(pass, index); index < end; index++) {
+                int id = identifier_at(pass, index);
+                if (id >= pass->keyword_count && !is_member_access(pass, index) &&
+                    declaration_pass_reserve(pass, (void **)&pass->pending_uses, &pass->pending_use_capacity, pass->pending_use_count, sizeof(int)) == 0) {
+                    pass->pending_uses[pass->pending_use_count++] = id;
+                }
+            }
+            continue;
+        }
+        if (is_punctuation_at(pass, index, '{')) break;
+        index++;
+    }
+    return index;
+}
+
+// Function to check if the ( after a declarator at block scope starts constructor arguments, as in Foo obj(3)
+// A body cannot follow at block scope, so only an empty list or one starting with a type declares a function
+static int is_direct_initializer(DeclarationPass *pass, int index) {
+    int scope_kind = pass->scopes[pass->scope_count - 1].kind;
+    int id = identifier_at(pass, index + 1);
+
+    if (!pass->is_cpp || scope_kind == SCOPE_FILE || scope_kind == SCOPE_MEMBERS || is_punctuation_at(pass, index + 1, ')')) {
+        return 0;
+    }
+    if (id >= 0 && id < pass->keyword_count) {
+        return id >= pass->tag_keywords;
+    }
+    return id < 0 || pass->bindings[id] < 0 || pass->declarations[pass->bindings[id]].kind != DECLARATION_TYPE;
+}
+
+// Function to parse the declarators of a declaration, starting after its type
+// Returns the index after the declaration; *complete is set if it ended with ; or at a function body
+static int parse_declarators(DeclarationPass *pass, int index, int kind, int *complete) {
+    *complete = 0;
+    for (;;) {
+        int name_index, pointer_declarator = 0, qualifier;
+
+        // Pointer and reference declarators and their qualifiers
+        while (is_punctuation_at(pass, index, '*') || is_punctuation_at(pass, index, '&') ||
+               ((qualifier = identifier_at(pass, index)) >= pass->type_keywords && qualifier < pass->qualifier_keywords)) {
+            index++;
+        }
+
+        if (is_punctuation_at(pass, index, '(') && is_punctuation_at(pass, index + 1, '*')) {
+            // Function pointer: (*name)
+            int i = index + 1;
+            while (is_punctuation_at(pass, i, '*')) i++;
+            if (!is_name_at(pass, i) || !is_punctuation_at(pass, i + 1, ')')) {
+                return index;
+            }
+            name_index = i;
+            pointer_declarator = 1;
+            index = i + 2;
+        } else if (is_name_at(pass, index)) {
+            name_index = index++;
+            // Qualified names such as Class::member
+            while (pass->is_cpp && is_punctuation_at(pass, index, ':') && is_punctuation_at(pass, index + 1, ':') &&
+                   is_name_at(pass, index + 2)) {
+                name_index = index + 2;
+                index += 3;
+            }
+        } else {
+            // A type without declarators, such as a forward declaration
+            if (is_punctuation_at(pass, index, ';')) {
+                *complete = 1;
+                return index + 1;
+            }
+            return index;
+        }
+
+        if (!pointer_declarator && is_punctuation_at(pass, index, '(') && !is_direct_initializer(pass, index)) {
+            // Function declarator: a body follows only for definitions at file or class scope
+            int scope_kind = pass->scopes[pass->scope_count - 1].kind, open = index;
+            index = parse_parameters(pass, index);
+            if (!pass->is_cpp && scope_kind == SCOPE_FILE && pass->pending_count == 0 && identifier_at(pass, index) >= 0) {
+                index = parse_old_style_parameters(pass, open, index);
+            }
+            while (identifier_at(pass, index) >= 0 && identifier_at(pass, index) < pass->keyword_count) {
+                index++;
+            }
+            pass->pending_use_count = 0;
+            if (pass->is_cpp && is_punctuation_at(pass, index, ':') && !is_punctuation_at(pass, index + 1, ':')) {
+                index = parse_initializer_list(pass, index + 1);
+            }
+            if (is_punctuation_at(pass, index, '{') && kind != DECLARATION_TYPE &&
+                (scope_kind == SCOPE_FILE || scope_kind == SCOPE_MEMBERS)) {
+                pass->pending_function = declaration_name(pass, token_at(pass, name_index));
+                pass->pending_line = token_at(pass, name_index)->line_number;
+                *complete = 1;
+                return index;
+            }
+            pass->pending_count = 0;
+            pass->pending_use_count = 0;
+        } else {
+            int name_id;
+
+            if (pointer_declarator && is_punctuation_at(pass, index, '(')) {
+                index = skip_brackets(pass, index);
+            }
+            // Array bounds, which for a variable length array read other variables
+            while (is_punctuation_at(pass, index, '[')) {
+                index = mark_expression_uses(pass, index + 1);
+                if (is_punctuation_at(pass, index, ']')) index++;
+            }
+            if (is_punctuation_at(pass, index, ':') && pass->scopes[pass->scope_count - 1].kind == SCOPE_MEMBERS) {
+                index = mark_expression_uses(pass, index + 1); // Bit-field width
+            }
+            // The initializer is read before the name comes into scope
+            if (is_punctuation_at(pass, index, '=')) {
+                index = mark_expression_uses(pass, index + 1);
+            } else if (pass->is_cpp && (is_punctuation_at(pass, index, '{') || is_punctuation_at(pass, index, '('))) {
+                index = mark_expression_uses(pass, index);
+            }
+            name_id = declaration_name(pass, token_at(pass, name_index));
+            if (name_id < 0) {
+                return index;
+            }
+            declare_name(pass, name_id, token_at(pass, name_index)->line_number, kind);
+        }
+
+        if (is_punctuation_at(pass, index, ',')) {
+            index++;
+            continue;
+        }
+        if (is_punctuation_at(pass, index, ';')) {
+            *complete = 1;
+            return index + 1;
+        }
+        return index;
+    }
+}
+
+// Function to parse a declaration at the start of a statement
+// Returns the index after the declaration, or -1 if the statement is not a declaration
+static int parse_declaration(DeclarationPass *pass, int index, int *complete) {
+    int type_seen = 0, kind = DECLARATION_VARIABLE;
+
+    *complete = 0;
+    while (token_at(pass, index) != NULL) {
+        int id = identifier_at(pass, index);
+
+        if (id < 0) break;
+        if (id == pass->typedef_id) {
+            kind = DECLARATION_TYPE;
+            index++;
+        } else if (id < pass->type_keywords) {
+            type_seen = 1;
+            index++;
+        } else if (id < pass->qualifier_keywords) {
+            index++;
+        } else if (id < pass->tag_keywords) {
+            index++;
+            if (is_name_at(pass, index)) index++;
+            // Qualified and specialized names such as ns::formatter<T>
+            while (pass->is_cpp && is_punctuation_at(pass, index, ':') && is_punctuation_at(pass, index + 1, ':') &&
+                   is_name_at(pass, index + 2)) {
+                index += 3;
+            }
+            if (pass->is_cpp && is_punctuation_at(pass, index, '<')) {
+                index = skip_template_arguments(pass, index);
+            }
+            if (pass->is_cpp && is_punctuation_at(pass, index, ':') && !is_punctuation_at(pass, index + 1, ':')) {
+                // Base class list
+                while (token_at(pass, index) != NULL && !is_punctuation_at(pass, index, '{') && !is_punctuation_at(pass, index, ';')) {
+                    index++;
+                }
+            }
+            type_seen = 1;
+            if (is_punctuation_at(pass, index, '{')) {
+                if (id == pass->enum_id) {
+                    // Enumerators are constants, not variables
+                    index = mark_expression_uses(pass, index);
+                    continue;
+                }
+                // Declarators after the body are parsed once its closing brace is reached
+                push_scope(pass, SCOPE_MEMBERS, current_function(pass), 0);
+                if (pass->failed) return -1;
+                pass->scopes[pass->scope_count - 1].state = kind == DECLARATION_TYPE ? 2 : 1;
+                *complete = 1;
+                return index + 1;
+            }
+        } else if (id < pass->keyword_count || type_seen) {
+            break;
+        } else if (pass->is_cpp && !type_seen && kind != DECLARATION_TYPE &&
+                   ((is_punctuation_at(pass, index + 1, '(') && pass->scopes[pass->scope_count - 1].kind == SCOPE_MEMBERS) ||
+                    (is_punctuation_at(pass, index + 1, ':') && is_punctuation_at(pass, index + 2, ':') &&
+                     identifier_at(pass, index + 3) == id && is_punctuation_at(pass, index + 4, '(')))) {
+            // A constructor has no type: a name called inside its class body, or Class::Class outside it
+            return parse_declarators(pass, index, kind, complete);
+        } else {
+            // A name in type position: a known type name, or any name followed by a declarator
+            int binding = pass->bindings[id];
+            int known_type = binding >= 0 && pass->declarations[binding].kind == DECLARATION_TYPE;
+            int after_type = index + 1, declarator, pointers = 0, qualifier;
+
+            while (pass->is_cpp && is_punctuation_at(pass, after_type, ':') && is_punctuation_at(pass, after_type + 1, ':') &&
+                   identifier_at(pass, after_type + 2) >= 0) {
+                after_type += 3;
+            }
+            if (pass->is_cpp && is_punctuation_at(pass, after_type, '<')) {
+                after_type = skip_template_arguments(pass, after_type);
+            }
+            for (declarator = after_type; token_at(pass, declarator) != NULL; declarator++) {
+                qualifier = identifier_at(pass, declarator);
+                if (is_punctuation_at(pass, declarator, '*') || is_punctuation_at(pass, declarator, '&')) {
+                    pointers++;
+                } else if (qualifier < pass->type_keywords || qualifier >= pass->qualifier_keywords) {
+                    break;
+                }
+            }
+            // A name before a type keyword is a macro such as DECLDIR in DECLDIR int f()
+            qualifier = identifier_at(pass, declarator);
+            if (!known_type && pointers == 0 && qualifier >= 0 && qualifier < pass->tag_keywords) {
+                index = after_type;
+                continue;
+            }
+            // a * b multiplies when a is a variable in scope
+            if (!known_type && (!is_name_at(pass, declarator) || (pointers > 0 && binding >= 0))) {
+                return -1;
+            }
+            index = after_type;
+            // A name followed by a type and its declarator is a macro such as an attribute, not the type
+            if (pointers == 0 && (is_name_at(pass, declarator + 1) || is_punctuation_at(pass, declarator + 1, '*') ||
+                                  is_punctuation_at(pass, declarator + 1, '&'))) {
+                continue;
+            }
+            type_seen = 1;
+        }
+    }
+
+    if (!type_seen || pass->failed) {
+        return -1;
+    }
+    return parse_declarators(pass, index, kind, complete);
+}
+
+// Function to open a braced block; a pending function definition gets its parameters declared in it
+static void open_block(DeclarationPass *pass, int index, int paren_depth) {
+    int kind = SCOPE_BLOCK;
+
+    if (pass->pending_function >= 0) {
+        FunctionDeclarations *function;
+
+        if (declaration_pass_reserve(pass, (void **)&pass->functions, &pass->function_capacity, pass->function_count, sizeof(FunctionDeclarations)) != 0) {
+            return;
+        }
+        function = &pass->functions[pass->function_count];
+        function->name_id = pass->pending_function;
+        function->line_number = pass->pending_line;
+        function->parameters = 0;
+        function->locals = 0;
+        push_scope(pass, SCOPE_BLOCK, pass->function_count++, paren_depth);
+        for (int i = 0; i + 1 < pass->pending_count && !pass->failed; i += 2) {
+            declare_name(pass, pass->pending_parameters[i], pass->pending_parameters[i + 1], DECLARATION_PARAMETER);
+        }
+        for (int i = 0; i < pass->pending_use_count; i++) {
+            mark_name_used(pass, pass->pending_uses[i]);
+        }
+        pass->pending_use_count = 0;
+        pass->pending_function = -1;
+        pass->pending_count = 0;
+        return;
+    }
+
+    // Namespace and extern "C" blocks keep file scope
+    if ((index >= 1 && identifier_at(pass, index - 1) == pass->namespace_id && pass->namespace_id >= 0) ||
+        (index >= 2 && identifier_at(pass, index - 2) == pass->namespace_id && pass->namespace_id >= 0) ||
+        (index >= 2 && token_at(pass, index - 1)->kind == TOKEN_LITERAL && identifier_at(pass, index - 2) == pass->extern_id)) {
+        kind = SCOPE_FILE;
+    } else if (pass->scopes[pass->scope_count - 1].kind == SCOPE_FILE) {
+        // Any other braces at file scope belong to something the pass did not recognize, such as a macro;
+        // their contents are not local variables
+        kind = SCOPE_MEMBERS;
+    }
+    push_scope(pass, kind, current_function(pass), paren_depth);
+}
+
+// Function to track the declarations and uses of names through a file's tokens
+// Scopes follow braces, for loop headers and the bodies of structs and classes
+void run_declaration_pass(DeclarationPass *pass, FileLine lines[], int total_lines) {
+    int control_depths[64]; // Parenthesis depths of open if/while/switch conditions
+    int control_count = 0, paren_depth = 0, statement_start = 1, label_pending = 0;
+    int index = 0;
+    SourceToken *token;
+
+    pass->lines = lines;
+    pass->total_lines = total_lines;
+    push_scope(pass, SCOPE_FILE, -1, 0);
+    while ((token = token_at(pass, index)) != NULL && !pass->failed) {
+        int at_statement_start = statement_start;
+        Scope *top;
+
+        release_tokens(pass, index);
+        token = token_at(pass, index);
+        if (statement_start && token->kind == TOKEN_IDENTIFIER) {
+            int complete, next = parse_declaration(pass, index, &complete);
+            if (next > index) {
+                index = next;
+                statement_start = complete;
+                continue;
+            }
+            token = token_at(pass, index);
+        }
+        statement_start = 0;
+        top = &pass->scopes[pass->scope_count - 1];
+
+        if (token->kind == TOKEN_IDENTIFIER) {
+            int id = declaration_name(pass, token);
+            if (id < 0) break;
+            if (id == pass->for_id && is_punctuation_at(pass, index + 1, '(')) {
+                push_scope(pass, SCOPE_FOR, current_function(pass), paren_depth++);
+                statement_start = 1;
+                index += 2;
+                continue;
+            }
+            // A template parameter list leaves the declaration after it at the start of the statement
+            if (id == pass->template_id && pass->template_id >= 0 && is_punctuation_at(pass, index + 1, '<')) {
+                int end = skip_template_arguments(pass, index + 1);
+                if (end > index + 1) {
+                    statement_start = 1;
+                    index = end;
+                    continue;
+                }
+            }
+            if (id < pass->keyword_count) {
+                if (id >= pass->tag_keywords && id < pass->control_keywords) {
+                    if (is_punctuation_at(pass, index + 1, '(') && control_count < 64) {
+                        control_depths[control_count++] = paren_depth;
+                    }
+                } else if (id >= pass->control_keywords && id < pass->prefix_keywords) {
+                    statement_start = 1;
+                } else if (id >= pass->prefix_keywords && id < pass->label_keywords) {
+                    label_pending = 1;
+                }
+            } else if (at_statement_start && is_punctuation_at(pass, index + 1, ':') &&
+                       !is_punctuation_at(pass, index + 2, ':')) {
+                label_pending = 1;
+            } else if (!is_member_access(pass, index)) {
+                mark_name_used(pass, id);
+            }
+        } else if (token->kind == TOKEN_PUNCTUATION) {
+            switch (token->text[0]) {
+            case '(':
+                paren_depth++;
+                break;
+            case ')':
+                if (paren_depth > 0) paren_depth--;
+                if (control_count > 0 && control_depths[control_count - 1] == paren_depth) {
+                    control_count--;
+                    statement_start = 1;
+                }
+                if (top->kind == SCOPE_FOR && top->state == 0 && top->paren_depth == paren_depth) {
+                    top->state = is_punctuation_at(pass, index + 1, '{') ? 1 : 2;
+                    statement_start = 1;
+                }
+                // A macro call at file scope often has no ;, so a word on a later line starts the next statement
+                if (top->kind == SCOPE_FILE && paren_depth == 0 && identifier_at(pass, index + 1) >= 0 &&
+                    token_at(pass, index + 1)->line_number > token->line_number) {
+                    statement_start = 1;
+                }
+                break;
+            case '{':
+                open_block(pass, index, paren_depth);
+                paren_depth = 0;
+                control_count = 0;
+                statement_start = 1;
+                break;
+            case '}': {
+                int kind, state, complete;
+
+                // For loops whose single statement body never reached its ;
+                while (pass->scope_count > 1 && pass->scopes[pass->scope_count - 1].kind == SCOPE_FOR) {
+                    pop_scope(pass);
+                }
+                if (pass->scope_count <= 1) break; // Unbalanced closing brace
+                top = &pass->scopes[pass->scope_count - 1];
+                kind = top->kind;
+                state = top->state;
+                paren_depth = top->paren_depth;
+                pop_scope(pass);
+                control_count = 0;
+                statement_start = 1;
+                if (kind == SCOPE_MEMBERS && state != 0) {
+                    index = parse_declarators(pass, index + 1,
+                                              state == 2 ? DECLARATION_TYPE : DECLARATION_VARIABLE, &complete);
+                    statement_start = complete;
+                    continue;
+                }
+                // The braced body of a for loop closes its scope too
+                if (pass->scopes[pass->scope_count - 1].kind == SCOPE_FOR && pass->scopes[pass->scope_count - 1].state == 1) {
+                    pop_scope(pass);
+                }
+                // So does a single statement body that ends with this block, unless an else continues it
+                while (pass->scope_count > 1 && pass->scopes[pass->scope_count - 1].kind == SCOPE_FOR &&
+                       pass->scopes[pass->scope_count - 1].state == 2 && identifier_at(pass, index + 1) != pass->else_id) {
+                    pop_scope(pass);
+                }
+                break;
+            }
+            case ';':
+                if (paren_depth == 0) {
+                    statement_start = 1;
+                    while (pass->scope_count > 1 && pass->scopes[pass->scope_count - 1].kind == SCOPE_FOR &&
+                           pass->scopes[pass->scope_count - 1].state == 2) {
+                        pop_scope(pass);
+                    }
+                } else if (top->kind == SCOPE_FOR && top->state == 0) {
+                    statement_start = 1;
+                }
+                break;
+            case ':':
+                if (label_pending) {
+                    label_pending = 0;
+                    statement_start = 1;
+                }
+                break;
+            }
+        }
+        index++;
+    }
+
+    while (pass->scope_count > 0) {
+        pop_scope(pass);
+    }
+}
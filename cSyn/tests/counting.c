@@ -0,0 +1,11 @@
+#include <stdio.h>
+
+void interrupt_handler(void);
+
+int main(void) {
+    int a, b, c;
+    a = b = c = 1;
+    printf("%d %d %d\n", a, b, c);
+    interrupt_handler();
+    return 0;
+}
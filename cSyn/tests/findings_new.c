@@ -0,0 +1,11 @@
+int first(void) {
+    int a = 1;
+    int b = 2;
+    int added = 4;
+    int c = 3;
+    return a + b + c;
+}
+
+int second(void) {
+    return 0;
+}
@@ -0,0 +1,10 @@
+int first(void) {
+    int a = 1;
+    int b = 2;
+    int c = 3;
+    return a + b + c;
+}
+
+int second(int unused) {
+    return 0;
+}
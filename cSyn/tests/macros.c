@@ -0,0 +1,17 @@
+DEFINE_STACK_OF(foo)
+struct stack_entry {
+    int length;
+    long flags;
+};
+
+DECLDIR int exported(void) {
+    int unused_local;
+    return 0;
+}
+
+int old_style(first, second)
+    int first;
+    char *second;
+{
+    return first + second[0];
+}
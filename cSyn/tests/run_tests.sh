@@ -0,0 +1,74 @@
+#!/bin/bash
+
+# Runs the syntax checker on the fixtures in this directory and checks its output
+# Each <name>.c is analyzed and every line of <name>.expect is checked against output.txt:
+# "+ text" must appear as a whole line, "- text" must not, and lines starting with # are comments
+# findings_old.c and findings_new.c are saved to findings stores and their diff compared with findings.diff
+# Usage: run_tests.sh <path to the syntax checker>
+
+if [ $# -ne 1 ]; then
+    echo "Usage: $0 <path to the syntax checker>"
+    exit 2
+fi
+
+checker=$(realpath "$1")
+tests_dir=$(cd "$(dirname "$0")" && pwd)
+work_dir=$(mktemp -d)
+failures=0
+
+# The checker writes output.txt to the current directory, so every run happens in a scratch directory
+trap 'rm -rf "$work_dir"' EXIT
+cd "$work_dir" || exit 2
+
+for expect_file in "$tests_dir"/*.expect; do
+    name=$(basename "$expect_file" .expect)
+    cp "$tests_dir/$name.c" .
+    if ! "$checker" "$name.c" > /dev/null; then
+        echo "FAIL $name: the checker exited with an error"
+        failures=$((failures + 1))
+        continue
+    fi
+
+    failed=0
+    while IFS= read -r line; do
+        case "$line" in
+            "+ "*)
+                if ! grep -Fxq -- "${line:2}" output.txt; then
+                    echo "FAIL $name: missing \"${line:2}\""
+                    failed=1
+                fi
+                ;;
+            "- "*)
+                if grep -Fxq -- "${line:2}" output.txt; then
+                    echo "FAIL $name: unexpected \"${line:2}\""
+                    failed=1
+                fi
+                ;;
+        esac
+    done < "$expect_file"
+
+    if [ $failed -eq 0 ]; then
+        echo "PASS $name"
+    else
+        failures=$((failures + 1))
+    fi
+done
+
+# Findings store round trip: write two runs of the same file name, read them back and diff them
+cp "$tests_dir/findings_old.c" findings.c
+"$checker" --findings old.bin findings.c > /dev/null
+cp "$tests_dir/findings_new.c" findings.c
+"$checker" --findings new.bin findings.c > /dev/null
+"$checker" diff old.bin new.bin > diff.txt
+if diff -u "$tests_dir/findings.diff" diff.txt; then
+    echo "PASS findings"
+else
+    echo "FAIL findings: the diff of the two stores differs from findings.diff"
+    failures=$((failures + 1))
+fi
+
+if [ $failures -ne 0 ]; then
+    echo "$failures test(s) failed"
+    exit 1
+fi
+echo "All tests passed"
@@ -0,0 +1,9 @@
+int total(int count, int ignored) {
+    int sum = 0;
+    int spare;
+    for (int i = 0; i < count; i++) {
+        int sum = i;
+        (void)sum;
+    }
+    return sum;
+}
@@ -0,0 +1,6 @@
+void fill(char *buffer);
+
+void scaled(int n) {
+    char buf[n * 2];
+    fill(buf);
+}